@@ -1,4 +1,4 @@
-//gcc 3d.c math3d.c -o editor.exe -lgdi32 -luser32 -lcomdlg32 -lmsimg32
+//gcc 3d.c lod.c bake.c specular.c math3d.c raster.c platform_win32.c -o editor.exe -lgdi32 -luser32 -lcomdlg32 -lmsimg32
 #include <windows.h>
 #include <stdint.h>
 #include <string.h>
@@ -6,6 +6,10 @@
 #include <float.h>
 #include <stdio.h>
 #include "math3d.h"
+#include "raster.h"
+#include "lod.h"
+#include "bake.h"
+#include "specular.h"
 #include <math.h>
 
 typedef struct {
@@ -18,10 +22,6 @@ typedef struct {
     int v2;
     int count;
 } edge_record_t;
-typedef struct {
-    vec4_t vertices[3];
-    vec3_t colors[3];
-} triangle_t;
 #define MAX_LIGHTS 32 // Support up to 32 lights in a scene
 
 // A temporary structure to hold pre-calculated light data for one frame
@@ -44,11 +44,8 @@ static int g_render_height;
 static vec4_t* g_clip_coords_buffer = NULL;
 static vec3_t* g_colors_buffer = NULL;
 static int g_vertex_buffer_capacity = 0;
-
-// --- Specular Lookup Table for powf() optimization ---
-#define SPECULAR_TABLE_SIZE 1024
-static float g_specular_lookup_table[SPECULAR_TABLE_SIZE];
-static float g_current_shininess_in_table = -1.0f; // Track what shininess the table was built for
+static uint8_t* g_face_visible_buffer = NULL; // Faces of the current object that survived backface culling
+static int g_face_buffer_capacity = 0;
 
 // Camera and Mouse Input Variables
 static float g_camera_distance = 6.0f;
@@ -65,6 +62,7 @@ static int g_is_orthographic = 0; // 0 = Perspective, 1 = Orthographic
 
 // Scene Management Variables
 static scene_t g_scene;
+static draw_order_t g_draw_order; // Objects nearest first, re-sorted every frame
 static selection_t g_selected_objects;
 static selection_t g_selected_components;
 static mesh_t* g_cube_mesh_data = NULL;
@@ -124,8 +122,7 @@ LRESULT CALLBACK window_callback(HWND, UINT, WPARAM, LPARAM);
 void render_frame();
 void draw_pixel(int, int, float, uint32_t);
 void draw_line(int x0, int y0, float z0, int x1, int y1, float z1, uint32_t color);
-void draw_filled_triangle(vec4_t, vec4_t, vec4_t, uint32_t);
-void draw_gouraud_triangle(vec4_t p0, vec4_t p1, vec4_t p2, vec3_t c0, vec3_t c1, vec3_t c2);
+void draw_clip_line(vec4_t p0, vec4_t p1, float depth_offset, uint32_t color);
 void draw_vertex_marker(int x, int y, float z, uint32_t c);
 void render_object(scene_object_t* object, int object_index, mat4_t view_matrix, mat4_t projection_matrix, vec3_t camera_pos, const active_light_t* lights, int light_count);
 void render_grid(mat4_t view_matrix, mat4_t projection_matrix);
@@ -144,6 +141,8 @@ void draw_thick_line(int x0, int y0, float z0, int x1, int y1, float z1, uint32_
 void normalize_rect(RECT* r);
 mesh_t* mesh_copy(const mesh_t* src);
 void mesh_calculate_normals(mesh_t* mesh);
+void mesh_build_edges(mesh_t* mesh);
+void mesh_invalidate_edges(mesh_t* mesh);
 void destroy_mesh_data(mesh_t* mesh);
 void draw_scene_outliner(HDC hdc);
 void draw_mode_ui(HDC hdc);
@@ -151,6 +150,7 @@ void draw_outliner_object_recursive(HDC hdc, int object_index, int depth, int* y
 void mesh_add_face(mesh_t* mesh, int v1, int v2, int v3);
 void mesh_delete_face(mesh_t* mesh, int face_index_to_delete);
 int mesh_add_vertex(mesh_t* mesh, vec3_t vertex);
+void scene_object_mesh_edited(scene_object_t* object);
 void selection_init(selection_t* s);
 void selection_remove(selection_t* s, int item_to_remove);
 void selection_add(selection_t* s, int item);
@@ -241,6 +241,13 @@ int scene_duplicate_object(scene_t* scene, int source_index) {
     } else {
         new_object->mesh = NULL;
     }
+    new_object->lod_count = 0;
+    new_object->lod_level = 0;
+    new_object->lods_authored = source_obj->lods_authored;
+    memset(new_object->baked_lighting, 0, sizeof(new_object->baked_lighting));
+    for (int i = 0; i < source_obj->lod_count; i++) {
+        scene_object_add_lod(new_object, mesh_copy(source_obj->lods[i]));
+    }
 
     // Deep copy light properties if they exist
     if (source_obj->light_properties) {
@@ -326,6 +333,10 @@ void scene_add_light(scene_t* scene, light_type_t type, vec3_t pos) {
     new_light_object->child_count = 0;
     new_light_object->child_capacity = 4;
     new_light_object->children = (int*)malloc(new_light_object->child_capacity * sizeof(int));
+    new_light_object->lod_count = 0;
+    new_light_object->lod_level = 0;
+    new_light_object->lods_authored = 0;
+    memset(new_light_object->baked_lighting, 0, sizeof(new_light_object->baked_lighting));
     new_light_object->is_double_sided = 0;
     new_light_object->is_static = 0;
 
@@ -344,6 +355,9 @@ void create_grid_face_at(vec3_t pos) {
     // 1. Create a new, temporary mesh for a 1x1 quad
     mesh_t* quad_mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!quad_mesh) return;
+    quad_mesh->edges = NULL;
+    quad_mesh->bounds_valid = 0;
+    quad_mesh->vertex_streams = NULL;
 
     quad_mesh->vertex_count = 4;
     quad_mesh->vertices = (vec3_t*)malloc(quad_mesh->vertex_count * sizeof(vec3_t));
@@ -414,6 +428,10 @@ void scene_add_object(scene_t* scene, mesh_t* mesh_data_source, vec3_t pos) {
     new_object->child_count = 0;
     new_object->child_capacity = 4;
     new_object->children = (int*)malloc(new_object->child_capacity * sizeof(int));
+    new_object->lod_count = 0;
+    new_object->lod_level = 0;
+    new_object->lods_authored = 0;
+    memset(new_object->baked_lighting, 0, sizeof(new_object->baked_lighting));
     new_object->is_double_sided = 1;
     new_object->is_static = 0;
     new_object->has_collision = 1; // Default to having collision
@@ -477,6 +495,7 @@ void scene_remove_object(scene_t* scene, int index_to_remove) {
 
     // Free the object's own memory
     destroy_mesh_data(obj_to_remove->mesh);
+    scene_object_free_lods(obj_to_remove);
     if (obj_to_remove->light_properties) {
         free(obj_to_remove->light_properties); // <-- NEW: Free light properties
     }
@@ -512,6 +531,7 @@ void scene_destroy(scene_t* scene) {
     for (int i = 0; i < scene->object_count; i++) {
         if (scene->objects[i]) {
             destroy_mesh_data(scene->objects[i]->mesh);
+            scene_object_free_lods(scene->objects[i]);
             if (scene->objects[i]->light_properties) { // NEW
                 free(scene->objects[i]->light_properties);
             }
@@ -536,7 +556,9 @@ int scene_load_from_file(scene_t* scene, const char* filename) {
     char header[4];
     fread(header, sizeof(char), 4, file);
 
-    int is_scn4_format = (strncmp(header, "SCN4", 4) == 0);
+    int is_scn6_format = (strncmp(header, "SCN6", 4) == 0);
+    int is_scn5_format = (strncmp(header, "SCN5", 4) == 0) || is_scn6_format; // SCN6 adds baked lighting after each mesh's LODs
+    int is_scn4_format = (strncmp(header, "SCN4", 4) == 0) || is_scn5_format; // SCN5 adds LOD meshes after each mesh
     int is_scn3_format = (strncmp(header, "SCN3", 4) == 0);
     int is_scn2_format = (strncmp(header, "SCN2", 4) == 0);
     int is_scn1_format = (strncmp(header, "SCN1", 4) == 0);
@@ -569,6 +591,10 @@ int scene_load_from_file(scene_t* scene, const char* filename) {
         new_obj->child_count = 0;
         new_obj->child_capacity = 4;
         new_obj->children = (int*)malloc(new_obj->child_capacity * sizeof(int));
+        new_obj->lod_count = 0;
+        new_obj->lod_level = 0;
+        new_obj->lods_authored = is_scn5_format; // Saved with LODs, so whatever chain it has is the one wanted
+        memset(new_obj->baked_lighting, 0, sizeof(new_obj->baked_lighting));
         
         if (is_scn4_format) {
             fread(new_obj->name, sizeof(char), 64, file);
@@ -643,6 +669,9 @@ int scene_load_from_file(scene_t* scene, const char* filename) {
             new_obj->mesh = (mesh_t*)malloc(sizeof(mesh_t));
             if (!new_obj->mesh) { free(new_obj->children); free(new_obj); continue; }
             new_obj->mesh->normals = NULL;
+            new_obj->mesh->edges = NULL;
+            new_obj->mesh->bounds_valid = 0;
+            new_obj->mesh->vertex_streams = NULL;
 
             fread(&new_obj->mesh->vertex_count, sizeof(int), 1, file);
             new_obj->mesh->vertices = (new_obj->mesh->vertex_count > 0) ? (vec3_t*)malloc(new_obj->mesh->vertex_count * sizeof(vec3_t)) : NULL;
@@ -653,6 +682,33 @@ int scene_load_from_file(scene_t* scene, const char* filename) {
             if (new_obj->mesh->faces) fread(new_obj->mesh->faces, sizeof(int), new_obj->mesh->face_count * 3, file);
 
             mesh_calculate_normals(new_obj->mesh);
+
+            if (is_scn5_format) {
+                int lod_count = 0;
+                fread(&lod_count, sizeof(int), 1, file);
+                for (int l = 0; l < lod_count; l++) {
+                    mesh_t* lod = (mesh_t*)calloc(1, sizeof(mesh_t));
+                    if (!lod) break;
+                    fread(&lod->vertex_count, sizeof(int), 1, file);
+                    lod->vertices = (lod->vertex_count > 0) ? (vec3_t*)malloc(lod->vertex_count * sizeof(vec3_t)) : NULL;
+                    if (lod->vertices) fread(lod->vertices, sizeof(vec3_t), lod->vertex_count, file);
+                    fread(&lod->face_count, sizeof(int), 1, file);
+                    lod->faces = (lod->face_count > 0) ? (int*)malloc(lod->face_count * 3 * sizeof(int)) : NULL;
+                    if (lod->faces) fread(lod->faces, sizeof(int), lod->face_count * 3, file);
+                    mesh_calculate_normals(lod);
+                    if (!scene_object_add_lod(new_obj, lod)) destroy_mesh_data(lod); // More levels than this build keeps
+                }
+            }
+            if (is_scn6_format) {
+                // Skipped: it goes stale with the first edit, and saving bakes afresh
+                int baked_levels = 0;
+                fread(&baked_levels, sizeof(int), 1, file);
+                for (int l = 0; l < baked_levels; l++) {
+                    int vertex_count = 0;
+                    fread(&vertex_count, sizeof(int), 1, file);
+                    if (vertex_count > 0) fseek(file, vertex_count * (long)sizeof(vec3_t), SEEK_CUR);
+                }
+            }
         }
 
         scene->objects[scene->object_count++] = new_obj;
@@ -671,6 +727,7 @@ int scene_load_from_file(scene_t* scene, const char* filename) {
     }
 
     fclose(file);
+    specular_cache_prepare(scene);
     return 1;
 }
 void scene_set_parent(scene_t* scene, int child_index, int parent_index) {
@@ -798,6 +855,9 @@ void model_load_from_file(scene_t* scene, const char* filename, vec3_t position)
         return;
     }
     new_mesh->normals = NULL; // Initialize normals pointer
+    new_mesh->edges = NULL;
+    new_mesh->bounds_valid = 0;
+    new_mesh->vertex_streams = NULL;
 
     // Read vertex data
     fread(&new_mesh->vertex_count, sizeof(int), 1, file);
@@ -863,8 +923,20 @@ void scene_save_to_file(scene_t* scene, const char* filename) {
         return;
     }
 
-    char header[4] = "SCN4"; // NEW FORMAT with names
+    char header[4] = "SCN6"; // SCN4 plus each mesh's LOD chain and baked lighting
     fwrite(header, sizeof(char), 4, file);
+
+    // LODs are generated here for objects that never had their chain made or cleared, and the
+    // lighting baked, so the player never has to at load
+    for (int i = 0; i < scene->object_count; i++) {
+        scene_object_t* obj = scene->objects[i];
+        if (obj->mesh && !obj->light_properties && !obj->lods_authored && obj->lod_count == 0 && obj->mesh->face_count >= LOD_MIN_FACES) {
+            scene_object_generate_lods(obj);
+        }
+        obj->lods_authored = 1;
+    }
+    scene_bake_lighting(scene); // Freed again below; the editor always lights every frame
+
     fwrite(&g_sky_color, sizeof(vec3_t), 1, file);
     fwrite(&scene->object_count, sizeof(int), 1, file);
 
@@ -902,6 +974,29 @@ void scene_save_to_file(scene_t* scene, const char* filename) {
             if (obj->mesh->face_count > 0) {
                 fwrite(obj->mesh->faces, sizeof(int), obj->mesh->face_count * 3, file);
             }
+
+            fwrite(&obj->lod_count, sizeof(int), 1, file);
+            for (int l = 0; l < obj->lod_count; l++) {
+                mesh_t* lod = obj->lods[l];
+                fwrite(&lod->vertex_count, sizeof(int), 1, file);
+                if (lod->vertex_count > 0) fwrite(lod->vertices, sizeof(vec3_t), lod->vertex_count, file);
+                fwrite(&lod->face_count, sizeof(int), 1, file);
+                if (lod->face_count > 0) fwrite(lod->faces, sizeof(int), lod->face_count * 3, file);
+            }
+
+            // Levels up to the last baked one; a level left unbaked is written as 0 vertices
+            int baked_levels = 0;
+            for (int l = 0; l <= obj->lod_count; l++) {
+                if (obj->baked_lighting[l]) baked_levels = l + 1;
+            }
+            fwrite(&baked_levels, sizeof(int), 1, file);
+            for (int l = 0; l < baked_levels; l++) {
+                const mesh_t* mesh = (l == 0) ? obj->mesh : obj->lods[l - 1];
+                int vertex_count = obj->baked_lighting[l] ? mesh->vertex_count : 0;
+                fwrite(&vertex_count, sizeof(int), 1, file);
+                if (vertex_count > 0) fwrite(obj->baked_lighting[l], sizeof(vec3_t), vertex_count, file);
+            }
+            scene_object_free_baked_lighting(obj);
         }
     }
 
@@ -992,6 +1087,7 @@ int mesh_add_vertex(mesh_t* mesh, vec3_t vertex) {
     
     // Add the new vertex at the end
     mesh->vertices[mesh->vertex_count] = vertex;
+    mesh_invalidate_bounds(mesh);
     
     // Return the index of the newly added vertex
     return mesh->vertex_count++;
@@ -1001,6 +1097,9 @@ mesh_t* mesh_copy(const mesh_t* src) {
     
     mesh_t* dst = (mesh_t*)malloc(sizeof(mesh_t));
     if (!dst) return NULL;
+    dst->edges = NULL;
+    dst->bounds_valid = 0;
+    dst->vertex_streams = NULL;
 
     // Copy vertices
     dst->vertex_count = src->vertex_count;
@@ -1042,6 +1141,7 @@ mesh_t* mesh_copy(const mesh_t* src) {
     return dst;
 }
 void mesh_calculate_normals(mesh_t* mesh) {
+    mesh_invalidate_vertex_streams(mesh); // Built again from the new normals on next use
     if (!mesh || mesh->vertex_count == 0 || mesh->face_count == 0) {
         if (mesh && mesh->normals) {
             free(mesh->normals);
@@ -1082,6 +1182,63 @@ void mesh_calculate_normals(mesh_t* mesh) {
         mesh->normals[i] = vec3_normalize(mesh->normals[i]);
     }
 }
+static int compare_mesh_edges(const void* a, const void* b) {
+    const mesh_edge_t* edge_a = (const mesh_edge_t*)a;
+    const mesh_edge_t* edge_b = (const mesh_edge_t*)b;
+    if (edge_a->v1 != edge_b->v1) return (edge_a->v1 < edge_b->v1) ? -1 : 1;
+    if (edge_a->v2 != edge_b->v2) return (edge_a->v2 < edge_b->v2) ? -1 : 1;
+    return (edge_a->face0 < edge_b->face0) ? -1 : (edge_a->face0 > edge_b->face0);
+}
+// Builds the mesh's unique edge list if it isn't cached yet. Every face contributes its
+// three edges; sorting brings the copies of a shared edge together so they collapse into
+// one entry that remembers both faces. A non-manifold edge (three or more faces) keeps
+// one entry per pair of faces.
+void mesh_build_edges(mesh_t* mesh) {
+    if (!mesh || mesh->edges) return;
+    mesh->edge_count = 0;
+    if (mesh->face_count == 0) return;
+
+    mesh_edge_t* edges = (mesh_edge_t*)malloc(mesh->face_count * 3 * sizeof(mesh_edge_t));
+    if (!edges) return;
+    int count = 0;
+    for (int i = 0; i < mesh->face_count; i++) {
+        for (int j = 0; j < 3; j++) {
+            int v1 = mesh->faces[i * 3 + j], v2 = mesh->faces[i * 3 + (j + 1) % 3];
+            if (v1 == v2) continue; // Degenerate face
+            edges[count++] = (mesh_edge_t){(v1 < v2) ? v1 : v2, (v1 > v2) ? v1 : v2, i, -1};
+        }
+    }
+    qsort(edges, count, sizeof(mesh_edge_t), compare_mesh_edges);
+
+    int unique_count = 0;
+    for (int i = 0; i < count; i++) {
+        mesh_edge_t* last = (unique_count > 0) ? &edges[unique_count - 1] : NULL;
+        if (last && last->v1 == edges[i].v1 && last->v2 == edges[i].v2 && last->face1 == -1) {
+            last->face1 = edges[i].face0;
+        } else {
+            edges[unique_count++] = edges[i];
+        }
+    }
+    if (unique_count == 0) { free(edges); return; }
+
+    mesh_edge_t* shrunk = (mesh_edge_t*)realloc(edges, unique_count * sizeof(mesh_edge_t));
+    mesh->edges = shrunk ? shrunk : edges;
+    mesh->edge_count = unique_count;
+}
+// Drops the cached edge list; call whenever the face list changes.
+void mesh_invalidate_edges(mesh_t* mesh) {
+    if (!mesh) return;
+    if (mesh->edges) free(mesh->edges);
+    mesh->edges = NULL;
+    mesh->edge_count = 0;
+}
+// Drops the LOD chain once the object's mesh has really changed, so the next save makes it
+// afresh; a chain the user cleared stays cleared.
+void scene_object_mesh_edited(scene_object_t* object) {
+    if (object->lod_count == 0) return;
+    scene_object_free_lods(object);
+    object->lods_authored = 0;
+}
 void mesh_delete_face(mesh_t* mesh, int face_index_to_delete) {
     if (!mesh || face_index_to_delete < 0 || face_index_to_delete >= mesh->face_count) {
         return;
@@ -1099,6 +1256,7 @@ void mesh_delete_face(mesh_t* mesh, int face_index_to_delete) {
     }
 
     mesh->face_count--;
+    mesh_invalidate_edges(mesh);
 
     // Optionally, reallocate to a smaller memory block to save space,
     // but for simplicity, we can skip this for now. It's a minor optimization.
@@ -1124,12 +1282,16 @@ void mesh_add_face(mesh_t* mesh, int v1, int v2, int v3) {
     mesh->faces[new_face_start_index + 2] = v3;
 
     mesh->face_count = new_face_count;
+    mesh_invalidate_edges(mesh);
     
     mesh_calculate_normals(mesh); 
 }
 mesh_t* create_vertex_mesh(void) {
     mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!mesh) return NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
     mesh->vertex_count = 1;
     mesh->vertices = (vec3_t*)malloc(sizeof(vec3_t));
     mesh->vertices[0] = (vec3_t){0, 0, 0};
@@ -1141,6 +1303,9 @@ mesh_t* create_vertex_mesh(void) {
 mesh_t* create_edge_mesh(void) {
     mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!mesh) return NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
     mesh->vertex_count = 2;
     mesh->vertices = (vec3_t*)malloc(2 * sizeof(vec3_t));
     mesh->vertices[0] = (vec3_t){-0.5f, 0, 0};
@@ -1153,6 +1318,9 @@ mesh_t* create_edge_mesh(void) {
 mesh_t* create_face_mesh(void) {
     mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!mesh) return NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
     mesh->vertex_count = 3;
     mesh->vertices = (vec3_t*)malloc(3 * sizeof(vec3_t));
     mesh->vertices[0] = (vec3_t){-0.5f, -0.5f, 0};
@@ -1169,6 +1337,9 @@ mesh_t* create_face_mesh(void) {
 mesh_t* create_cube_mesh(void) {
     mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!mesh) return NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
     mesh->vertex_count = 8;
     mesh->vertices = (vec3_t*)malloc(mesh->vertex_count * sizeof(vec3_t));
     // Bottom face vertices (Z = -0.5)
@@ -1215,6 +1386,9 @@ mesh_t* create_sphere_mesh(int segments, int rings) {
 
     mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!mesh) return NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
 
     mesh->vertex_count = segments * (rings - 1) + 2;
     mesh->face_count = segments * rings * 2;
@@ -1311,6 +1485,9 @@ mesh_t* create_sphere_mesh(int segments, int rings) {
 mesh_t* create_player_spawn_mesh(void) {
     mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!mesh) return NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
     mesh->vertex_count = 5;
     mesh->vertices = (vec3_t*)malloc(mesh->vertex_count * sizeof(vec3_t));
     // Base vertices on the XY plane (at Z = 0)
@@ -1342,6 +1519,9 @@ mesh_t* create_player_spawn_mesh(void) {
 mesh_t* create_pyramid_mesh(void) {
     mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
     if (!mesh) return NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
     mesh->vertex_count = 5;
     mesh->vertices = (vec3_t*)malloc(mesh->vertex_count * sizeof(vec3_t));
     // Base vertices on the XY plane (at Z = -0.5)
@@ -1375,6 +1555,8 @@ void destroy_mesh_data(mesh_t* mesh) {
     if (mesh->vertices) free(mesh->vertices);
     if (mesh->faces) free(mesh->faces);
     if (mesh->normals) free(mesh->normals);
+    if (mesh->edges) free(mesh->edges);
+    free(mesh->vertex_streams);
     free(mesh);
 }
 void destroy_and_apply_coord_edit() {
@@ -1411,6 +1593,8 @@ void destroy_and_apply_coord_edit() {
                 // --- NEW: Recalculate normals if a vertex was moved ---
                 if (recalculate_normals) {
                     mesh_calculate_normals(object->mesh);
+                    mesh_invalidate_bounds(object->mesh);
+                    scene_object_mesh_edited(object);
                 }
             }
         }
@@ -1962,6 +2146,8 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line,
     g_edge_mesh_data = create_edge_mesh();
     g_face_mesh_data = create_face_mesh();
     g_player_spawn_mesh_data = create_player_spawn_mesh(); // <-- ADD THIS LINE
+    raster_configure(cmd_line); // "-raster=halfspace" selects the block walker
+    raster_init(0); // One rasterizer thread per logical core
     
     scene_add_object(&g_scene, g_cube_mesh_data, (vec3_t){-1.0f, 0.0f, 0.0f});
     scene_add_object(&g_scene, g_pyramid_mesh_data, (vec3_t){1.0f, 0.0f, 0.0f});
@@ -2062,12 +2248,8 @@ void render_frame() {
     uint8_t b = (uint8_t)(g_sky_color.z * 255.0f);
     uint32_t clear_color = (r << 16) | (g << 8) | b;
 
-    // --- MODIFIED: Clear buffers based on render resolution ---
-    uint32_t* pixel = (uint32_t*)g_framebuffer_memory;
-    for (int i = 0; i < g_render_width * g_render_height; ++i) {
-        *pixel++ = clear_color;
-        g_depth_buffer[i] = FLT_MAX;
-    }
+    raster_clear((uint32_t*)g_framebuffer_memory, clear_color, g_depth_buffer, g_render_width, g_render_height);
+    raster_begin_frame((uint32_t*)g_framebuffer_memory, g_depth_buffer, g_render_width, g_render_height);
 
     vec3_t offset;
     offset.x = g_camera_distance * cosf(g_camera_pitch) * cosf(g_camera_yaw);
@@ -2091,6 +2273,7 @@ void render_frame() {
     } else {
         projection_matrix = mat4_perspective(3.14159f / 4.0f, aspect_ratio, 0.1f, 100.0f);
     }
+    raster_set_depth_range(projection_matrix, 0.1f, 100.0f); // Reject triangles past far; integer depth spans near..far
 
     active_light_t active_lights[MAX_LIGHTS];
     int light_count = 0;
@@ -2114,112 +2297,20 @@ void render_frame() {
 
     render_grid(view_matrix, projection_matrix);
     
-    for (int i = 0; i < g_scene.object_count; i++) {
-        render_object(g_scene.objects[i], i, view_matrix, projection_matrix, camera_pos, active_lights, light_count);
-    }
-}
-void build_specular_table(float shininess) {
-    if (shininess == g_current_shininess_in_table) {
-        return; // Table is already built for this shininess value
-    }
-    for (int i = 0; i < SPECULAR_TABLE_SIZE; i++) {
-        float cos_angle = (float)i / (float)(SPECULAR_TABLE_SIZE - 1);
-        g_specular_lookup_table[i] = powf(cos_angle, shininess);
-    }
-    g_current_shininess_in_table = shininess;
-}
-int clip_triangle_against_near_plane(triangle_t* in_tri, triangle_t* out_tri1, triangle_t* out_tri2) {
-    vec4_t inside_points[3];  int inside_count = 0;
-    vec3_t inside_colors[3];
-    vec4_t outside_points[3]; int outside_count = 0;
-    vec3_t outside_colors[3];
-
-    // A small epsilon to avoid issues with triangles exactly on the plane
-    const float near_plane_w = 0.001f;
-
-    // Categorize each vertex as being inside or outside the near plane
-    for (int i = 0; i < 3; i++) {
-        if (in_tri->vertices[i].w > near_plane_w) {
-            inside_points[inside_count] = in_tri->vertices[i];
-            inside_colors[inside_count] = in_tri->colors[i];
-            inside_count++;
-        } else {
-            outside_points[outside_count] = in_tri->vertices[i];
-            outside_colors[outside_count] = in_tri->colors[i];
-            outside_count++;
+    // Nearest objects first, so the depth test rejects most hidden pixels early
+    draw_order_update(&g_draw_order, &g_scene, camera_pos);
+    frustum_t frustum = frustum_from_camera(view_matrix, projection_matrix, 100.0f);
+    for (int n = 0; n < g_draw_order.count; n++) {
+        int i = g_draw_order.indices[n];
+        scene_object_t* object = g_scene.objects[i];
+        // Light gizmos and the player model's camera marker reach outside the mesh bounds
+        if (!object->light_properties && !object->is_player_model &&
+            !frustum_test_mesh(&frustum, object->mesh, mat4_get_world_transform(&g_scene, i))) {
+            continue;
         }
+        render_object(object, i, view_matrix, projection_matrix, camera_pos, active_lights, light_count);
     }
-
-    // --- Process based on how many vertices are visible ---
-
-    if (inside_count == 3) {
-        // The entire triangle is visible, no clipping needed
-        *out_tri1 = *in_tri;
-        return 1;
-    }
-
-    if (inside_count == 0) {
-        // The entire triangle is behind the camera, discard it
-        return 0;
-    }
-
-    if (inside_count == 1) {
-        // The triangle is cut, leaving one smaller triangle
-        out_tri1->vertices[0] = inside_points[0];
-        out_tri1->colors[0] = inside_colors[0];
-
-        // This triangle has one visible vertex and two outside.
-        // We must calculate the two new vertices where the edges
-        // cross the near plane.
-        for (int i = 0; i < 2; i++) {
-            float t = (inside_points[0].w - near_plane_w) / (inside_points[0].w - outside_points[i].w);
-            out_tri1->vertices[i + 1].x = inside_points[0].x + t * (outside_points[i].x - inside_points[0].x);
-            out_tri1->vertices[i + 1].y = inside_points[0].y + t * (outside_points[i].y - inside_points[0].y);
-            out_tri1->vertices[i + 1].z = inside_points[0].z + t * (outside_points[i].z - inside_points[0].z);
-            out_tri1->vertices[i + 1].w = inside_points[0].w + t * (outside_points[i].w - outside_points[0].w);
-
-            out_tri1->colors[i + 1].x = inside_colors[0].x + t * (outside_colors[i].x - inside_colors[0].x);
-            out_tri1->colors[i + 1].y = inside_colors[0].y + t * (outside_colors[i].y - inside_colors[0].y);
-            out_tri1->colors[i + 1].z = inside_colors[0].z + t * (outside_colors[i].z - inside_colors[0].z);
-        }
-        return 1;
-    }
-
-    if (inside_count == 2) {
-        // The triangle is cut, leaving a quad which we split into two triangles.
-        // First output triangle
-        out_tri1->vertices[0] = inside_points[0];
-        out_tri1->vertices[1] = inside_points[1];
-        out_tri1->colors[0] = inside_colors[0];
-        out_tri1->colors[1] = inside_colors[1];
-
-        float t0 = (inside_points[0].w - near_plane_w) / (inside_points[0].w - outside_points[0].w);
-        out_tri1->vertices[2].x = inside_points[0].x + t0 * (outside_points[0].x - inside_points[0].x);
-        out_tri1->vertices[2].y = inside_points[0].y + t0 * (outside_points[0].y - inside_points[0].y);
-        out_tri1->vertices[2].z = inside_points[0].z + t0 * (outside_points[0].z - inside_points[0].z);
-        out_tri1->vertices[2].w = inside_points[0].w + t0 * (outside_points[0].w - inside_points[0].w);
-        out_tri1->colors[2].x = inside_colors[0].x + t0 * (outside_colors[0].x - inside_colors[0].x);
-        out_tri1->colors[2].y = inside_colors[0].y + t0 * (outside_colors[0].y - inside_colors[0].y);
-        out_tri1->colors[2].z = inside_colors[0].z + t0 * (outside_colors[0].z - inside_colors[0].z);
-
-        // Second output triangle
-        out_tri2->vertices[0] = inside_points[1];
-        out_tri2->colors[0] = inside_colors[1];
-        out_tri2->vertices[1] = out_tri1->vertices[2]; // Reuse the previously calculated intersection point
-        out_tri2->colors[1] = out_tri1->colors[2];
-
-        float t1 = (inside_points[1].w - near_plane_w) / (inside_points[1].w - outside_points[0].w);
-        out_tri2->vertices[2].x = inside_points[1].x + t1 * (outside_points[0].x - inside_points[1].x);
-        out_tri2->vertices[2].y = inside_points[1].y + t1 * (outside_points[0].y - inside_points[1].y);
-        out_tri2->vertices[2].z = inside_points[1].z + t1 * (outside_points[0].z - inside_points[1].z);
-        out_tri2->vertices[2].w = inside_points[1].w + t1 * (outside_points[0].w - inside_points[1].w);
-        out_tri2->colors[2].x = inside_colors[1].x + t1 * (outside_colors[0].x - inside_colors[1].x);
-        out_tri2->colors[2].y = inside_colors[1].y + t1 * (outside_colors[0].y - inside_colors[1].y);
-        out_tri2->colors[2].z = inside_colors[1].z + t1 * (outside_colors[0].z - inside_colors[1].z);
-
-        return 2;
-    }
-    return 0; // Should not happen
+    raster_end_frame(); // Grid, wireframe and markers were drawn directly; depth testing keeps them in front
 }
 void render_object(scene_object_t* object, int object_index, mat4_t view_matrix, mat4_t projection_matrix, vec3_t camera_pos, const active_light_t* lights, int light_count) {
     if (object->light_properties) {
@@ -2287,6 +2378,14 @@ void render_object(scene_object_t* object, int object_index, mat4_t view_matrix,
              return;
         }
     }
+    if (object->mesh->face_count > g_face_buffer_capacity) {
+        g_face_buffer_capacity = object->mesh->face_count;
+        g_face_visible_buffer = (uint8_t*)realloc(g_face_visible_buffer, g_face_buffer_capacity);
+        if (!g_face_visible_buffer) {
+             g_face_buffer_capacity = 0;
+             return;
+        }
+    }
 
     mat4_t model_matrix = mat4_get_world_transform(&g_scene, object_index);
     mat4_t final_transform = mat4_mul_mat4(projection_matrix, mat4_mul_mat4(view_matrix, model_matrix));
@@ -2297,9 +2396,8 @@ void render_object(scene_object_t* object, int object_index, mat4_t view_matrix,
     if (g_shading_mode == SHADING_SMOOTH && object->mesh->normals && !object->is_player_spawn) { // Player spawn is always solid color
         use_precomputed_colors = 1;
         
-        if (object->material.specular_intensity > 0.0f) {
-            build_specular_table(object->material.shininess);
-        }
+        // Cached per shininess, so objects with different materials no longer rebuild a shared table
+        const float* specular_table = (object->material.specular_intensity > 0.0f) ? specular_table_get(object->material.shininess) : NULL;
 
         for (int i = 0; i < object->mesh->vertex_count; i++) {
             g_clip_coords_buffer[i] = mat4_mul_vec4(final_transform, (vec4_t){object->mesh->vertices[i].x, object->mesh->vertices[i].y, object->mesh->vertices[i].z, 1.0f});
@@ -2338,8 +2436,7 @@ void render_object(scene_object_t* object, int object_index, mat4_t view_matrix,
                         vec3_t reflect_dir = vec3_sub(vec3_scale(n_world, 2.0f * vec3_dot(n_world, light_dir)), light_dir);
                         float spec_angle = fmax(vec3_dot(view_dir, reflect_dir), 0.0f);
                         
-                        int table_index = (int)(spec_angle * (SPECULAR_TABLE_SIZE - 1));
-                        float specular_term = g_specular_lookup_table[table_index];
+                        float specular_term = specular_table ? specular_lookup(specular_table, spec_angle) : powf(spec_angle, object->material.shininess);
                         
                         specular_sum = vec3_add(specular_sum, vec3_scale(light_prop->color, specular_term * object->material.specular_intensity * attenuation));
                     }
@@ -2361,6 +2458,7 @@ void render_object(scene_object_t* object, int object_index, mat4_t view_matrix,
             
             vec4_t v_clip[3] = { g_clip_coords_buffer[v_indices[0]], g_clip_coords_buffer[v_indices[1]], g_clip_coords_buffer[v_indices[2]] };
 
+            g_face_visible_buffer[i] = 0;
             if (v_clip[0].w > 0 && v_clip[1].w > 0 && v_clip[2].w > 0) {
                  vec3_t v0_ndc = {v_clip[0].x/v_clip[0].w, v_clip[0].y/v_clip[0].w, v_clip[0].z/v_clip[0].w};
                  vec3_t v1_ndc = {v_clip[1].x/v_clip[1].w, v_clip[1].y/v_clip[1].w, v_clip[1].z/v_clip[1].w};
@@ -2370,58 +2468,39 @@ void render_object(scene_object_t* object, int object_index, mat4_t view_matrix,
                      continue;
                  }
             }
+            g_face_visible_buffer[i] = 1;
 
-            triangle_t original_tri;
-            for(int j=0; j<3; j++) {
-                original_tri.vertices[j] = v_clip[j];
+            // Fill: the rasterizer rejects and clips against the frustum itself
+            if (g_shading_mode != SHADING_WIREFRAME) {
                 if (use_precomputed_colors) {
-                    original_tri.colors[j] = g_colors_buffer[v_indices[j]];
+                    raster_submit_gouraud(v_clip[0], v_clip[1], v_clip[2], g_colors_buffer[v_indices[0]], g_colors_buffer[v_indices[1]], g_colors_buffer[v_indices[2]]);
                 } else {
-                    original_tri.colors[j] = object->material.diffuse_color;
+                    uint8_t r = (uint8_t)(object->material.diffuse_color.x * 255.0f);
+                    uint8_t g = (uint8_t)(object->material.diffuse_color.y * 255.0f);
+                    uint8_t b = (uint8_t)(object->material.diffuse_color.z * 255.0f);
+                    uint32_t face_color = (r << 16) | (g << 8) | b;
+                     if (g_current_mode == MODE_EDIT && g_edit_mode_component == EDIT_FACES && is_object_selected && selection_contains(&g_selected_components, i)) { face_color = 0xFFFFA500; }
+                    raster_submit_flat(v_clip[0], v_clip[1], v_clip[2], face_color);
                 }
             }
+        }
 
-            triangle_t clipped_tris[2];
-            int num_clipped = clip_triangle_against_near_plane(&original_tri, &clipped_tris[0], &clipped_tris[1]);
-
-            for (int t = 0; t < num_clipped; t++) {
-                if (g_shading_mode != SHADING_WIREFRAME) {
-                    if (use_precomputed_colors) {
-                        draw_gouraud_triangle(clipped_tris[t].vertices[0], clipped_tris[t].vertices[1], clipped_tris[t].vertices[2], clipped_tris[t].colors[0], clipped_tris[t].colors[1], clipped_tris[t].colors[2]);
-                    } else {
-                        uint8_t r = (uint8_t)(clipped_tris[t].colors[0].x * 255.0f);
-                        uint8_t g = (uint8_t)(clipped_tris[t].colors[0].y * 255.0f);
-                        uint8_t b = (uint8_t)(clipped_tris[t].colors[0].z * 255.0f);
-                        uint32_t face_color = (r << 16) | (g << 8) | b;
-                         if (g_current_mode == MODE_EDIT && g_edit_mode_component == EDIT_FACES && is_object_selected && selection_contains(&g_selected_components, i)) { face_color = 0xFFFFA500; }
-                        draw_filled_triangle(clipped_tris[t].vertices[0], clipped_tris[t].vertices[1], clipped_tris[t].vertices[2], face_color);
-                    }
-                }
-
-                vec4_t sp[3];
-                for(int j=0; j<3; ++j) {
-                    sp[j] = clipped_tris[t].vertices[j];
-                    if(sp[j].w != 0) {
-                        sp[j].x = (sp[j].x / sp[j].w + 1.0f) * 0.5f * g_render_width;
-                        sp[j].y = (1.0f - sp[j].y / sp[j].w) * 0.5f * g_render_height;
-                        sp[j].z /= sp[j].w;
-                    }
-                }
-                
-                uint32_t wire_color;
-                if (object->is_player_spawn) { 
-                    wire_color = 0xFFFF0000; // Red
-                } else if (object->is_player_model) { // <-- NEW
-                    wire_color = 0xFF00FF00; // Bright Green
-                } else if (g_current_editor_mode == EDITOR_SCENE && object->is_static) {
-                    wire_color = 0xFF606060;
-                } else {
-                    wire_color = (g_current_mode==MODE_OBJECT)?(is_object_selected?0xFFFF00:0xFFFFFF):(is_object_selected?0xFFFF00:0xFF808080);
-                }
-                draw_line(sp[0].x,sp[0].y,sp[0].z - 0.002f, sp[1].x,sp[1].y,sp[1].z - 0.002f, wire_color);
-                draw_line(sp[1].x,sp[1].y,sp[1].z - 0.002f, sp[2].x,sp[2].y,sp[2].z - 0.002f, wire_color);
-                draw_line(sp[2].x,sp[2].y,sp[2].z - 0.002f, sp[0].x,sp[0].y,sp[0].z - 0.002f, wire_color);
-            }
+        // Wireframe: every unique edge once, if a face on either side survived culling
+        uint32_t wire_color;
+        if (object->is_player_spawn) { 
+            wire_color = 0xFFFF0000; // Red
+        } else if (object->is_player_model) { // <-- NEW
+            wire_color = 0xFF00FF00; // Bright Green
+        } else if (g_current_editor_mode == EDITOR_SCENE && object->is_static) {
+            wire_color = 0xFF606060;
+        } else {
+            wire_color = (g_current_mode==MODE_OBJECT)?(is_object_selected?0xFFFF00:0xFFFFFF):(is_object_selected?0xFFFF00:0xFF808080);
+        }
+        mesh_build_edges(object->mesh);
+        for (int i = 0; i < object->mesh->edge_count; i++) {
+            const mesh_edge_t* edge = &object->mesh->edges[i];
+            if (!g_face_visible_buffer[edge->face0] && (edge->face1 < 0 || !g_face_visible_buffer[edge->face1])) continue;
+            draw_clip_line(g_clip_coords_buffer[edge->v1], g_clip_coords_buffer[edge->v2], -0.002f, wire_color);
         }
     } 
     
@@ -2878,7 +2957,7 @@ mat4_t mat4_orthographic(float left, float right, float bottom, float top, float
     return m;
 }
 // --- Drawing Helper Functions ---
-void draw_pixel(int x,int y,float z,uint32_t c){if(x>=0&&x<g_render_width&&y>=0&&y<g_render_height){int i=x+y*g_render_width;if(z<g_depth_buffer[i]){*((uint32_t*)g_framebuffer_memory+i)=c;g_depth_buffer[i]=z;}}}
+void draw_pixel(int x,int y,float z,uint32_t c){if(x>=0&&x<g_render_width&&y>=0&&y<g_render_height){if(raster_depth_test_and_set(x,y,z)){*((uint32_t*)g_framebuffer_memory+x+y*g_render_width)=c;}}}
 void draw_vertex_marker(int x, int y, float z, uint32_t c){
     for(int i=-1; i<=1; i++){
         for(int j=-1; j<=1; j++){
@@ -2887,170 +2966,76 @@ void draw_vertex_marker(int x, int y, float z, uint32_t c){
     }
 }
 void draw_line(int x0,int y0,float z0,int x1,int y1,float z1,uint32_t c){int dx=abs(x1-x0),sx=x0<x1?1:-1,dy=-abs(y1-y0),sy=y0<y1?1:-1,err=dx+dy,e2;float z=z0,dz=(z1-z0)/sqrtf((float)(x1-x0)*(x1-x0)+(y1-y0)*(y1-y0));for(;;){draw_pixel(x0,y0,z,c);if(x0==x1&&y0==y1)break;e2=2*err;if(e2>=dy){err+=dy;x0+=sx;z+=dz*sx;}if(e2<=dx){err+=dx;y0+=sy;z+=dz*sy;}}}
-void draw_filled_triangle(vec4_t p0, vec4_t p1, vec4_t p2, uint32_t c) {
-    if (p0.w <= 0 || p1.w <= 0 || p2.w <= 0) return;
-
-    // Perspective divide
-    float p0w_inv = 1.0f / p0.w; p0.x *= p0w_inv; p0.y *= p0w_inv; p0.z *= p0w_inv;
-    float p1w_inv = 1.0f / p1.w; p1.x *= p1w_inv; p1.y *= p1w_inv; p1.z *= p1w_inv;
-    float p2w_inv = 1.0f / p2.w; p2.x *= p2w_inv; p2.y *= p2w_inv; p2.z *= p2w_inv;
-
-    // Screen space transform
-    p0.x = (p0.x + 1.0f) * 0.5f * g_render_width; p0.y = (1.0f - p0.y) * 0.5f * g_render_height;
-    p1.x = (p1.x + 1.0f) * 0.5f * g_render_width; p1.y = (1.0f - p1.y) * 0.5f * g_render_height;
-    p2.x = (p2.x + 1.0f) * 0.5f * g_render_width; p2.y = (1.0f - p2.y) * 0.5f * g_render_height; // <-- THIS LINE IS FIXED
-
-    // Sort vertices by Y
-    if (p0.y > p1.y) { vec4_t t = p0; p0 = p1; p1 = t; float tw = p0w_inv; p0w_inv = p1w_inv; p1w_inv = tw; }
-    if (p0.y > p2.y) { vec4_t t = p0; p0 = p2; p2 = t; float tw = p0w_inv; p0w_inv = p2w_inv; p2w_inv = tw; }
-    if (p1.y > p2.y) { vec4_t t = p1; p1 = p2; p2 = t; float tw = p1w_inv; p1w_inv = p2w_inv; p2w_inv = tw; }
-
-    int y_start = (int)(p0.y + 0.5f);
-    int y_end = (int)(p2.y + 0.5f);
-
-    y_start = (y_start < 0) ? 0 : y_start;
-    y_end = (y_end > g_render_height) ? g_render_height : y_end;
-    
-    float dy_total = p2.y - p0.y;
-    float dy_split = p1.y - p0.y;
-
-    for (int y = y_start; y < y_end; y++) {
-        float factor1 = (dy_total > 0) ? ((float)y - p0.y) / dy_total : 0;
-        float factor2 = (y < p1.y) 
-            ? ((dy_split > 0) ? ((float)y - p0.y) / dy_split : 0)
-            : ((p2.y - p1.y > 0) ? ((float)y - p1.y) / (p2.y - p1.y) : 0);
-
-        float xa_f = p0.x + factor1 * (p2.x - p0.x);
-        float wa_inv = p0w_inv + factor1 * (p2w_inv - p0w_inv);
-
-        float xb_f = (y < p1.y) 
-            ? (p0.x + factor2 * (p1.x - p0.x)) 
-            : (p1.x + factor2 * (p2.x - p1.x));
-        float wb_inv = (y < p1.y)
-            ? (p0w_inv + factor2 * (p1w_inv - p0w_inv))
-            : (p1w_inv + factor2 * (p2w_inv - p1w_inv));
-
-        if (xa_f > xb_f) { 
-            float temp_x = xa_f; xa_f = xb_f; xb_f = temp_x;
-            float temp_w = wa_inv; wa_inv = wb_inv; wb_inv = temp_w;
+// Draws a clip-space segment: clipped against the near plane, projected, clipped to the
+// viewport (Liang-Barsky) and then walked with Bresenham straight into the buffers, so
+// no pixel needs a bounds check. Depth is NDC z plus depth_offset, like draw_line.
+void draw_clip_line(vec4_t p0, vec4_t p1, float depth_offset, uint32_t color) {
+    const float near_w = 0.001f;
+    if (p0.w <= near_w && p1.w <= near_w) return;
+    if (p0.w <= near_w || p1.w <= near_w) {
+        float t = (p0.w - near_w) / (p0.w - p1.w);
+        vec4_t cut = {p0.x + t * (p1.x - p0.x), p0.y + t * (p1.y - p0.y), p0.z + t * (p1.z - p0.z), near_w};
+        if (p0.w <= near_w) p0 = cut; else p1 = cut;
+    }
+
+    float x0 = (p0.x / p0.w + 1.0f) * 0.5f * g_render_width, y0 = (1.0f - p0.y / p0.w) * 0.5f * g_render_height, z0 = p0.z / p0.w + depth_offset;
+    float x1 = (p1.x / p1.w + 1.0f) * 0.5f * g_render_width, y1 = (1.0f - p1.y / p1.w) * 0.5f * g_render_height, z1 = p1.z / p1.w + depth_offset;
+
+    // Liang-Barsky: shrink [t_enter, t_exit] by each of the four viewport edges
+    float dx = x1 - x0, dy = y1 - y0, t_enter = 0.0f, t_exit = 1.0f;
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {x0, (float)(g_render_width - 1) - x0, y0, (float)(g_render_height - 1) - y0};
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0.0f) {
+            if (q[i] < 0.0f) return; // Parallel to this edge and outside it
+            continue;
         }
-
-        int x_start = (int)(xa_f + 0.5f);
-        int x_end = (int)(xb_f + 0.5f);
-
-        x_start = (x_start < 0) ? 0 : x_start;
-        x_end = (x_end > g_render_width) ? g_render_width : x_end;
-        
-        float scanline_width = xb_f - xa_f;
-        if (scanline_width <= 0) continue;
-
-        float w_inv_step = (wb_inv - wa_inv) / scanline_width;
-        float initial_offset = (float)x_start - xa_f;
-        float current_w_inv = wa_inv + w_inv_step * initial_offset;
-        
-        uint32_t* row = (uint32_t*)g_framebuffer_memory + y * g_render_width;
-        float* depth_row = g_depth_buffer + y * g_render_width;
-
-        for (int x = x_start; x < x_end; x++) {
-            if (current_w_inv > 0) {
-                float z = 1.0f / current_w_inv;
-                if (z < depth_row[x]) {
-                    row[x] = c;
-                    depth_row[x] = z;
-                }
-            }
-            current_w_inv += w_inv_step;
+        float t = q[i] / p[i];
+        if (p[i] < 0.0f) { if (t > t_exit) return; if (t > t_enter) t_enter = t; }
+        else             { if (t < t_enter) return; if (t < t_exit) t_exit = t; }
+    }
+    float dz = z1 - z0;
+    int ix0 = (int)(x0 + t_enter * dx), iy0 = (int)(y0 + t_enter * dy);
+    int ix1 = (int)(x0 + t_exit * dx), iy1 = (int)(y0 + t_exit * dy);
+    ix0 = (ix0 < 0) ? 0 : (ix0 >= g_render_width) ? g_render_width - 1 : ix0;
+    ix1 = (ix1 < 0) ? 0 : (ix1 >= g_render_width) ? g_render_width - 1 : ix1;
+    iy0 = (iy0 < 0) ? 0 : (iy0 >= g_render_height) ? g_render_height - 1 : iy0;
+    iy1 = (iy1 < 0) ? 0 : (iy1 >= g_render_height) ? g_render_height - 1 : iy1;
+
+    raster_prepare_depth((ix0 < ix1) ? ix0 : ix1, (iy0 < iy1) ? iy0 : iy1, ((ix0 > ix1) ? ix0 : ix1) + 1, ((iy0 > iy1) ? iy0 : iy1) + 1);
+
+    int step_dx = abs(ix1 - ix0), step_dy = -abs(iy1 - iy0);
+    int step_x = (ix0 < ix1) ? 1 : -1, step_y = (iy0 < iy1) ? g_render_width : -g_render_width;
+    int steps = (step_dx > -step_dy) ? step_dx : -step_dy;
+    float z = z0 + t_enter * dz;
+    float z_step = (steps > 0) ? (t_exit - t_enter) * dz / (float)steps : 0.0f;
+
+    uint32_t* color_buffer = (uint32_t*)g_framebuffer_memory;
+    int index = iy0 * g_render_width + ix0, end_index = iy1 * g_render_width + ix1;
+    int err = step_dx + step_dy;
+    if (raster_get_depth_format() != RASTER_DEPTH_FLOAT32) {
+        // Integer depth lives inside the rasterizer, so each pixel goes through it
+        int x = ix0, y = iy0, step_row = (iy0 < iy1) ? 1 : -1;
+        for (;;) {
+            if (raster_depth_test_and_set(x, y, z)) color_buffer[y * g_render_width + x] = color;
+            if (x == ix1 && y == iy1) break;
+            int e2 = 2 * err;
+            if (e2 >= step_dy) { err += step_dy; x += step_x; }
+            if (e2 <= step_dx) { err += step_dx; y += step_row; }
+            z += z_step;
         }
+        return;
     }
-}
-void draw_gouraud_triangle(vec4_t p0, vec4_t p1, vec4_t p2, vec3_t c0, vec3_t c1, vec3_t c2) {
-    if (p0.w <= 0 || p1.w <= 0 || p2.w <= 0) return;
-
-    // Perspective divide
-    float p0w_inv = 1.0f / p0.w; p0.x *= p0w_inv; p0.y *= p0w_inv; p0.z *= p0w_inv;
-    float p1w_inv = 1.0f / p1.w; p1.x *= p1w_inv; p1.y *= p1w_inv; p1.z *= p1w_inv;
-    float p2w_inv = 1.0f / p2.w; p2.x *= p2w_inv; p2.y *= p2w_inv; p2.z *= p2w_inv;
-
-    // Screen space transform
-    p0.x = (p0.x + 1.0f) * 0.5f * g_render_width;  p0.y = (1.0f - p0.y) * 0.5f * g_render_height;
-    p1.x = (p1.x + 1.0f) * 0.5f * g_render_width;  p1.y = (1.0f - p1.y) * 0.5f * g_render_height;
-    p2.x = (p2.x + 1.0f) * 0.5f * g_render_width;  p2.y = (1.0f - p2.y) * 0.5f * g_render_height;
-
-    // Pre-calculate colors divided by w for perspective-correct interpolation
-    vec3_t c0_pw = vec3_scale(c0, p0w_inv);
-    vec3_t c1_pw = vec3_scale(c1, p1w_inv);
-    vec3_t c2_pw = vec3_scale(c2, p2w_inv);
-
-    // Sort vertices by Y
-    if (p0.y > p1.y) { vec4_t tp = p0; p0 = p1; p1 = tp; vec3_t tc = c0_pw; c0_pw = c1_pw; c1_pw = tc; float tw = p0w_inv; p0w_inv = p1w_inv; p1w_inv = tw; }
-    if (p0.y > p2.y) { vec4_t tp = p0; p0 = p2; p2 = tp; vec3_t tc = c0_pw; c0_pw = c2_pw; c2_pw = tc; float tw = p0w_inv; p0w_inv = p2w_inv; p2w_inv = tw; }
-    if (p1.y > p2.y) { vec4_t tp = p1; p1 = p2; p2 = tp; vec3_t tc = c1_pw; c1_pw = c2_pw; c2_pw = tc; float tw = p1w_inv; p1w_inv = p2w_inv; p2w_inv = tw; }
-
-    int y_start = (int)(p0.y + 0.5f);
-    int y_end = (int)(p2.y + 0.5f);
-
-    y_start = (y_start < 0) ? 0 : y_start;
-    y_end = (y_end > g_render_height) ? g_render_height : y_end;
-
-    float dy_total = p2.y - p0.y;
-    float dy_split = p1.y - p0.y;
-
-    for (int y = y_start; y < y_end; y++) {
-        float factor1 = (dy_total > 0) ? ((float)y - p0.y) / dy_total : 0;
-        float factor2 = (y < p1.y) 
-            ? ((dy_split > 0) ? ((float)y - p0.y) / dy_split : 0)
-            : ((p2.y - p1.y > 0) ? ((float)y - p1.y) / (p2.y - p1.y) : 0);
-
-        float xa_f = p0.x + factor1 * (p2.x - p0.x);
-        float wa_inv = p0w_inv + factor1 * (p2w_inv - p0w_inv);
-        vec3_t ca_pw = vec3_add(c0_pw, vec3_scale(vec3_sub(c2_pw, c0_pw), factor1));
-
-        float xb_f = (y < p1.y) ? (p0.x + factor2 * (p1.x - p0.x)) : (p1.x + factor2 * (p2.x - p1.x));
-        float wb_inv = (y < p1.y) ? (p0w_inv + factor2 * (p1w_inv - p0w_inv)) : (p1w_inv + factor2 * (p2w_inv - p1w_inv));
-        vec3_t cb_pw = (y < p1.y) ? vec3_add(c0_pw, vec3_scale(vec3_sub(c1_pw, c0_pw), factor2)) : vec3_add(c1_pw, vec3_scale(vec3_sub(c2_pw, c1_pw), factor2));
-
-        if (xa_f > xb_f) { 
-            float temp_x = xa_f; xa_f = xb_f; xb_f = temp_x;
-            float temp_w = wa_inv; wa_inv = wb_inv; wb_inv = temp_w;
-            vec3_t temp_c = ca_pw; ca_pw = cb_pw; cb_pw = temp_c;
-        }
-
-        int x_start = (int)(xa_f + 0.5f);
-        int x_end = (int)(xb_f + 0.5f);
-
-        x_start = (x_start < 0) ? 0 : x_start;
-        x_end = (x_end > g_render_width) ? g_render_width : x_end;
-
-        float scanline_width = xb_f - xa_f;
-        if (scanline_width <= 0) continue;
-
-        vec3_t c_pw_step = vec3_scale(vec3_sub(cb_pw, ca_pw), 1.0f / scanline_width);
-        float w_inv_step = (wb_inv - wa_inv) / scanline_width;
-
-        float initial_offset = (float)x_start - xa_f;
-        vec3_t current_c_pw = vec3_add(ca_pw, vec3_scale(c_pw_step, initial_offset));
-        float current_w_inv = wa_inv + w_inv_step * initial_offset;
-        
-        uint32_t* row = (uint32_t*)g_framebuffer_memory + y * g_render_width;
-        float* depth_row = g_depth_buffer + y * g_render_width;
-
-        for (int x = x_start; x < x_end; x++) {
-            if (current_w_inv > 0) {
-                float z = 1.0f / current_w_inv;
-                if (z < depth_row[x]) {
-                    vec3_t final_color = vec3_scale(current_c_pw, z);
-
-                    uint8_t r = (uint8_t)(fmin(1.0f, final_color.x) * 255.0f);
-                    uint8_t g = (uint8_t)(fmin(1.0f, final_color.y) * 255.0f);
-                    uint8_t b = (uint8_t)(fmin(1.0f, final_color.z) * 255.0f);
-                    
-                    row[x] = (r << 16) | (g << 8) | b;
-                    depth_row[x] = z;
-                }
-            }
-            current_c_pw = vec3_add(current_c_pw, c_pw_step);
-            current_w_inv += w_inv_step;
+    for (;;) {
+        if (z < g_depth_buffer[index]) {
+            color_buffer[index] = color;
+            g_depth_buffer[index] = z;
         }
+        if (index == end_index) break;
+        int e2 = 2 * err;
+        if (e2 >= step_dy) { err += step_dy; index += step_x; }
+        if (e2 <= step_dx) { err += step_dx; index += step_y; }
+        z += z_step;
     }
 }
 void draw_pixel_thick(int x, int y, float z, uint32_t color) {
@@ -3101,6 +3086,10 @@ case WM_CLOSE: case WM_DESTROY: {
             if(g_transform_initial_vertices) free(g_transform_initial_vertices);
             if(g_clip_coords_buffer) free(g_clip_coords_buffer);
             if(g_colors_buffer) free(g_colors_buffer);
+            if(g_face_visible_buffer) free(g_face_visible_buffer);
+            draw_order_free(&g_draw_order);
+            specular_cache_clear();
+            raster_shutdown();
             PostQuitMessage(0);
         } break;
         case WM_SIZE: {
@@ -3269,7 +3258,7 @@ case WM_LBUTTONDOWN: {
                 if (scaled_mx >= outliner_panel_x) {
                     int is_shift_down = GetKeyState(VK_SHIFT) & 0x8000;
                     int clicked_outliner_object = -1;
-                    for (int i = 0; i < g_scene.object_count; i++) { if (PtInRect(&g_scene.objects[i]->ui_outliner_rect, pt)) { clicked_outliner_object = i; break; } }
+                    for (int i = 0; i < g_scene.object_count; i++) { const rect_t* r = &g_scene.objects[i]->ui_outliner_rect; if (pt.x >= r->left && pt.x < r->right && pt.y >= r->top && pt.y < r->bottom) { clicked_outliner_object = i; break; } }
                     if (clicked_outliner_object != -1) {
                         int was_already_selected = selection_contains(&g_selected_objects, clicked_outliner_object);
                         if (is_shift_down) {
@@ -3318,6 +3307,7 @@ case WM_LBUTTONUP: {
                     scene_object_t* obj = g_scene.objects[g_selected_objects.items[0]];
                     if (obj && obj->mesh) {
                         mesh_calculate_normals(obj->mesh);
+                        scene_object_mesh_edited(obj); // Confirmed; a cancelled move puts the vertices back
                     }
                 }
                 
@@ -3445,6 +3435,7 @@ case WM_LBUTTONUP: {
                         }
                     } else if (g_current_mode == MODE_EDIT && g_transform_initial_vertices) {
                         memcpy(obj->mesh->vertices, g_transform_initial_vertices, obj->mesh->vertex_count * sizeof(vec3_t));
+                        mesh_invalidate_bounds(obj->mesh);
                         free(g_transform_initial_vertices);
                         g_transform_initial_vertices = NULL;
                     }
@@ -3958,6 +3949,7 @@ case WM_COMMAND: {
                         case TRANSFORM_NONE: break;
                         case TRANSFORM_LIGHT_INTENSITY: break;
                     }
+                    mesh_invalidate_bounds(obj->mesh);
                 }
             } else if (g_middle_mouse_down && (GetKeyState(VK_SHIFT) & 0x8000)) {
                 g_mouse_dragged=1; float sens=0.0025f*g_camera_distance;
@@ -4008,6 +4000,7 @@ case WM_COMMAND: {
                                 }
                             } else if (g_current_mode == MODE_EDIT && g_transform_initial_vertices) {
                                 memcpy(obj->mesh->vertices, g_transform_initial_vertices, obj->mesh->vertex_count * sizeof(vec3_t));
+                                mesh_invalidate_bounds(obj->mesh);
                                 free(g_transform_initial_vertices);
                                 g_transform_initial_vertices = NULL;
                             }
@@ -4029,12 +4022,45 @@ case WM_COMMAND: {
                         for (int i = 0; i < g_selected_components.count; i++) {
                             mesh_delete_face(mesh, g_selected_components.items[i]);
                         }
+                        scene_object_mesh_edited(object);
                         selection_clear(&g_selected_components);
                     }
                     return 0;
                 }
             }
 
+            // L: generate LODs for the selection, Shift+L: clear them,
+            // Ctrl+L: append the other selected objects' meshes to the first one's chain (their
+            // local coordinates are used as they are, so model them around the same origin)
+            if (w_param == 'L' && g_current_mode == MODE_OBJECT && g_selected_objects.count > 0 && g_current_transform_mode == TRANSFORM_NONE) {
+                scene_object_t* first_obj = g_scene.objects[g_selected_objects.items[0]];
+                if (GetKeyState(VK_CONTROL) & 0x8000) {
+                    if (first_obj->mesh) {
+                        for (int i = 1; i < g_selected_objects.count; i++) {
+                            scene_object_t* lod_obj = g_scene.objects[g_selected_objects.items[i]];
+                            if (!lod_obj->mesh) continue;
+                            mesh_t* lod = mesh_copy(lod_obj->mesh);
+                            if (!scene_object_add_lod(first_obj, lod)) {
+                                destroy_mesh_data(lod);
+                                break;
+                            }
+                        }
+                        first_obj->lods_authored = 1;
+                    }
+                } else {
+                    for (int i = 0; i < g_selected_objects.count; i++) {
+                        scene_object_t* obj = g_scene.objects[g_selected_objects.items[i]];
+                        if (GetKeyState(VK_SHIFT) & 0x8000) {
+                            scene_object_free_lods(obj); // Stays without LODs, saving included
+                        } else {
+                            scene_object_generate_lods(obj);
+                        }
+                        obj->lods_authored = 1;
+                    }
+                }
+                return 0;
+            }
+
             if (w_param == 'D' && (GetKeyState(VK_SHIFT) & 0x8000)) {
                 if (g_current_mode == MODE_OBJECT && g_selected_objects.count > 0 && g_current_transform_mode == TRANSFORM_NONE) {
                     selection_t new_selection;
@@ -4162,6 +4188,7 @@ case WM_COMMAND: {
                         int v3_idx = g_selected_components.items[i + 1];
                         mesh_add_face(object->mesh, root_vertex_idx, v2_idx, v3_idx);
                     }
+                    scene_object_mesh_edited(object);
                     selection_clear(&g_selected_components);
                 }
             }
@@ -4223,6 +4250,7 @@ case WM_COMMAND: {
                         selection_destroy(&unique_verts);
                     }
                     free(old_to_new_map);
+                    scene_object_mesh_edited(object); // The new faces stay even if the grab is cancelled
                     
                     g_current_transform_mode = TRANSFORM_GRAB;
                     g_transform_axis_is_locked = 0;
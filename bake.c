@@ -0,0 +1,157 @@
+// bake.c
+// Static vertex lighting, evaluated with the renderer's diffuse model and culled per object
+// with the same light_reaches_sphere() test, so a baked mesh looks the same as one lit every
+// frame.
+
+#include "bake.h"
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct {
+    vec3_t position;
+    vec3_t direction; // For spotlights
+    const light_t* properties;
+    float cos_outer;  // Cosine of the cone's half angle
+    float cos_inner;  // ...and of the angle where the blend to the edge starts
+    light_reach_t reach;
+} bake_light_t;
+
+// --- Function Declarations ---
+static int gather_fixed_lights(const scene_t* scene, bake_light_t** lights);
+static int can_bake(const scene_t* scene, int object_index);
+static vec3_t* bake_mesh(const mesh_t* mesh, mat4_t world, const bake_light_t* lights, int light_count);
+
+int scene_object_is_fixed(const scene_t* scene, int object_index) {
+    // Bounded by the object count in case a broken file links parents in a loop
+    for (int depth = 0; object_index >= 0 && object_index < scene->object_count && depth < scene->object_count; depth++) {
+        const scene_object_t* object = scene->objects[object_index];
+        if (!object->is_static || object->is_player_model) return 0; // The player model moves whatever its flags say
+        object_index = object->parent_index;
+    }
+    return 1;
+}
+
+// Spawn markers are never drawn
+static int can_bake(const scene_t* scene, int object_index) {
+    const scene_object_t* object = scene->objects[object_index];
+    return !object->light_properties && !object->is_player_spawn &&
+           object->mesh && object->mesh->normals && scene_object_is_fixed(scene, object_index);
+}
+
+int scene_bake_lighting(scene_t* scene) {
+    bake_light_t* lights = NULL;
+    int light_count = gather_fixed_lights(scene, &lights);
+    if (light_count < 0) return 0;
+    bake_light_t* object_lights = (bake_light_t*)malloc((light_count > 0 ? light_count : 1) * sizeof(bake_light_t));
+    if (!object_lights) {
+        free(lights);
+        return 0;
+    }
+
+    int baked = 0;
+    for (int i = 0; i < scene->object_count; i++) {
+        scene_object_t* object = scene->objects[i];
+        scene_object_free_baked_lighting(object);
+        if (!can_bake(scene, i)) continue;
+
+        // The lights the renderer would give this object, tested against the full mesh's
+        // bounds as it does for every level
+        mat4_t world = mat4_get_world_transform(scene, i);
+        vec3_t center;
+        float radius;
+        mesh_world_sphere(object->mesh, world, &center, &radius);
+        int object_light_count = 0;
+        for (int l = 0; l < light_count; l++) {
+            if (light_reaches_sphere(&lights[l].reach, center, radius)) object_lights[object_light_count++] = lights[l];
+        }
+
+        int complete = 1;
+        for (int level = 0; level <= object->lod_count && complete; level++) {
+            const mesh_t* mesh = (level == 0) ? object->mesh : object->lods[level - 1];
+            if (!mesh->normals) continue; // Drawn lit every frame
+            object->baked_lighting[level] = bake_mesh(mesh, world, object_lights, object_light_count);
+            complete = (object->baked_lighting[level] != NULL);
+        }
+        if (!complete) {
+            scene_object_free_baked_lighting(object);
+            continue;
+        }
+        baked++;
+    }
+    free(object_lights);
+    free(lights);
+    return baked;
+}
+
+// Ambient plus each light's diffuse term per vertex, to be multiplied by the material's
+// diffuse color. NULL if out of memory.
+static vec3_t* bake_mesh(const mesh_t* mesh, mat4_t world, const bake_light_t* lights, int light_count) {
+    vec3_t* lighting = (vec3_t*)malloc((mesh->vertex_count > 0 ? mesh->vertex_count : 1) * sizeof(vec3_t));
+    if (!lighting) return NULL;
+
+    for (int v = 0; v < mesh->vertex_count; v++) {
+        vec4_t v_world_4 = mat4_mul_vec4(world, (vec4_t){mesh->vertices[v].x, mesh->vertices[v].y, mesh->vertices[v].z, 1.0f});
+        vec3_t v_world = {v_world_4.x, v_world_4.y, v_world_4.z};
+        vec4_t n_world_4 = mat4_mul_vec4(world, (vec4_t){mesh->normals[v].x, mesh->normals[v].y, mesh->normals[v].z, 0.0f});
+        vec3_t n_world = vec3_normalize((vec3_t){n_world_4.x, n_world_4.y, n_world_4.z});
+
+        vec3_t diffuse_sum = {0.1f, 0.1f, 0.1f}; // Ambient term, as in the renderer
+        for (int l = 0; l < light_count; l++) {
+            const bake_light_t* light = &lights[l];
+            vec3_t to_light = vec3_sub(light->position, v_world);
+            float dist_sq = vec3_dot(to_light, to_light);
+            if(dist_sq < 1e-6) dist_sq = 1e-6;
+            vec3_t light_dir = vec3_normalize(to_light);
+            float attenuation = light->properties->intensity / dist_sq;
+            float diff_intensity = fmax(vec3_dot(n_world, light_dir), 0.0f);
+
+            if (light->properties->type == LIGHT_TYPE_SPOT) {
+                float theta = vec3_dot(light_dir, vec3_scale(light->direction, -1.0f));
+                if (theta > light->cos_outer) {
+                    float spot_effect = (theta - light->cos_outer) / (light->cos_inner - light->cos_outer);
+                    spot_effect = (spot_effect < 0.0f) ? 0.0f : (spot_effect > 1.0f) ? 1.0f : spot_effect;
+                    attenuation *= spot_effect;
+                } else {
+                    attenuation = 0;
+                }
+            }
+            if (attenuation > 0) {
+                diffuse_sum = vec3_add(diffuse_sum, vec3_scale(light->properties->color, diff_intensity * attenuation));
+            }
+        }
+        lighting[v] = diffuse_sum;
+    }
+    return lighting;
+}
+
+void scene_object_free_baked_lighting(scene_object_t* object) {
+    for (int level = 0; level <= MAX_LOD_LEVELS; level++) {
+        free(object->baked_lighting[level]);
+        object->baked_lighting[level] = NULL;
+    }
+}
+
+// Returns the number of fixed lights in a new array, or -1 if out of memory
+static int gather_fixed_lights(const scene_t* scene, bake_light_t** lights) {
+    *lights = (bake_light_t*)malloc((scene->object_count > 0 ? scene->object_count : 1) * sizeof(bake_light_t));
+    if (!*lights) return -1;
+    int count = 0;
+    for (int i = 0; i < scene->object_count; i++) {
+        const scene_object_t* obj = scene->objects[i];
+        if (!obj->light_properties || !scene_object_is_fixed(scene, i)) continue;
+        bake_light_t* light = &(*lights)[count++];
+        mat4_t light_transform = mat4_get_world_transform(scene, i);
+        light->position = (vec3_t){light_transform.m[0][3], light_transform.m[1][3], light_transform.m[2][3]};
+        light->properties = obj->light_properties;
+        if (obj->light_properties->type == LIGHT_TYPE_SPOT) {
+            mat4_t rot_matrix = mat4_mul_mat4(mat4_rotation_z(obj->rotation.z), mat4_mul_mat4(mat4_rotation_y(obj->rotation.y), mat4_rotation_x(obj->rotation.x)));
+            vec4_t local_dir = {0, 0, -1, 0};
+            vec4_t world_dir4 = mat4_mul_vec4(rot_matrix, local_dir);
+            light->direction = vec3_normalize((vec3_t){world_dir4.x, world_dir4.y, world_dir4.z});
+            light->cos_outer = cosf(obj->light_properties->spot_angle / 2.0f);
+            light->cos_inner = cosf((obj->light_properties->spot_angle / 2.0f) * (1.0f - obj->light_properties->spot_blend));
+        }
+        light->reach = light_reach(obj->light_properties, light->position, light->direction);
+    }
+    return count;
+}
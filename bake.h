@@ -0,0 +1,20 @@
+// bake.h
+// Baked vertex lighting: the ambient and diffuse light that lights which never move give
+// the meshes which never move, worked out once instead of every frame. The renderer only
+// adds their view-dependent specular and whatever the moving lights contribute.
+
+#ifndef BAKE_H
+#define BAKE_H
+#include "math3d.h"
+
+// 1 if the object and every parent above it are is_static (and none is the player model), so
+// its world transform never changes
+int scene_object_is_fixed(const scene_t* scene, int object_index);
+// Bakes every fixed mesh (and its LODs) against the fixed lights that reach it, replacing what
+// the objects held before; objects that can move are left without. Each level gets a color per vertex:
+// the ambient term plus each fixed light's diffuse term, to be multiplied by the material's
+// diffuse color. Returns how many objects were baked.
+int scene_bake_lighting(scene_t* scene);
+void scene_object_free_baked_lighting(scene_object_t* object);
+
+#endif // BAKE_H
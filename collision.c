@@ -0,0 +1,261 @@
+// collision.c
+// Ray and sphere queries against the scene's collision geometry.
+
+#include "collision.h"
+#include <math.h>
+
+static int ray_intersects_triangle(vec3_t ro, vec3_t rv, vec3_t v0, vec3_t v1, vec3_t v2, float* d, vec3_t* normal) {
+    const float EPS = 1e-7f;
+    vec3_t e1 = vec3_sub(v1, v0);
+    vec3_t e2 = vec3_sub(v2, v0);
+    
+    vec3_t face_normal = vec3_normalize(vec3_cross(e1, e2));
+
+    // This check is for rays parallel to the triangle plane.
+    float n_dot_rv = vec3_dot(face_normal, rv);
+    if (fabs(n_dot_rv) < EPS) {
+        return 0; // Ray is parallel, no intersection.
+    }
+
+    vec3_t h = vec3_cross(rv, e2);
+    float a = vec3_dot(e1, h);
+
+    // This check is for rays that are nearly parallel inside the triangle plane.
+    if (a > -EPS && a < EPS) return 0;
+
+    float f = 1.f / a;
+    vec3_t s = vec3_sub(ro, v0);
+    float u = f * vec3_dot(s, h);
+    if (u < 0.f || u > 1.f) return 0;
+
+    vec3_t q = vec3_cross(s, e1);
+    float v = f * vec3_dot(rv, q);
+    if (v < 0.f || u + v > 1.f) return 0;
+    
+    float t = f * vec3_dot(e2, q);
+    if (t > EPS) {
+        if (d) *d = t;
+        if (normal) {
+            // If the ray and normal are pointing in the same general direction,
+            // it means we've hit a back-face. We need to flip the collision normal
+            // so we are always pushed "out" of the geometry.
+            if (n_dot_rv > 0) {
+                *normal = vec3_scale(face_normal, -1.0f);
+            } else {
+                *normal = face_normal;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+int raycast_scene(const scene_t* scene, vec3_t ray_origin, vec3_t ray_dir, float max_dist, float* hit_dist, vec3_t* hit_normal, int ignore_index) {
+    int hit = 0;
+    float closest_dist = max_dist;
+
+    for (int i = 0; i < scene->object_count; i++) {
+        if (i == ignore_index) continue; // <-- THE NEW LINE
+
+        scene_object_t* obj = scene->objects[i];
+        if (!obj->mesh || !obj->has_collision) continue;
+
+        mat4_t model_matrix = mat4_get_world_transform(scene, i);
+
+        // This is a broad-phase optimization to quickly discard distant objects.
+        // It's been made more robust to avoid incorrectly culling nearby floors.
+        vec3_t center = { model_matrix.m[0][3], model_matrix.m[1][3], model_matrix.m[2][3] };
+        float max_scale = fmax(obj->scale.x, fmax(obj->scale.y, obj->scale.z));
+        float radius = 1.732f * max_scale; // Radius that encloses a 1x1x1 cube.
+        
+        vec3_t oc = vec3_sub(center, ray_origin);
+        float b = vec3_dot(oc, ray_dir);
+        float c = vec3_dot(oc, oc) - radius * radius;
+        if (c > 0.0f && b < 0.0f) continue; // Sphere is behind and we're moving away
+        float discriminant = b*b - c;
+        if (discriminant < 0.0f) continue; // Ray misses sphere
+
+        // Narrow-phase: Check every triangle in the mesh
+        for (int j = 0; j < obj->mesh->face_count; j++) {
+            int v0i = obj->mesh->faces[j * 3 + 0];
+            int v1i = obj->mesh->faces[j * 3 + 1];
+            int v2i = obj->mesh->faces[j * 3 + 2];
+
+            vec4_t v0w_4 = mat4_mul_vec4(model_matrix, (vec4_t){obj->mesh->vertices[v0i].x, obj->mesh->vertices[v0i].y, obj->mesh->vertices[v0i].z, 1});
+            vec4_t v1w_4 = mat4_mul_vec4(model_matrix, (vec4_t){obj->mesh->vertices[v1i].x, obj->mesh->vertices[v1i].y, obj->mesh->vertices[v1i].z, 1});
+            vec4_t v2w_4 = mat4_mul_vec4(model_matrix, (vec4_t){obj->mesh->vertices[v2i].x, obj->mesh->vertices[v2i].y, obj->mesh->vertices[v2i].z, 1});
+            
+            vec3_t v0 = {v0w_4.x, v0w_4.y, v0w_4.z};
+            vec3_t v1 = {v1w_4.x, v1w_4.y, v1w_4.z};
+            vec3_t v2 = {v2w_4.x, v2w_4.y, v2w_4.z};
+            
+            float dist;
+            vec3_t normal;
+            if (ray_intersects_triangle(ray_origin, ray_dir, v0, v1, v2, &dist, &normal)) {
+                if (dist < closest_dist) {
+                    closest_dist = dist;
+                    if(hit_normal) *hit_normal = normal;
+                    hit = 1;
+                }
+            }
+        }
+    }
+
+    if (hit) {
+        if(hit_dist) *hit_dist = closest_dist;
+    }
+    return hit;
+}
+static vec3_t find_closest_point_on_line_segment(vec3_t p, vec3_t a, vec3_t b) {
+    vec3_t ab = vec3_sub(b, a);
+    float t = vec3_dot(vec3_sub(p, a), ab) / vec3_dot(ab, ab);
+    if (t < 0.0f) t = 0.0f;
+    if (t > 1.0f) t = 1.0f;
+    return vec3_add(a, vec3_scale(ab, t));
+}
+static vec3_t find_closest_point_on_triangle(vec3_t p, vec3_t a, vec3_t b, vec3_t c) {
+    vec3_t ab = vec3_sub(b, a);
+    vec3_t ac = vec3_sub(c, a);
+    vec3_t normal = vec3_cross(ab, ac);
+    float normal_len_sq = vec3_length_sq(normal);
+
+    // Project p onto the triangle's plane
+    vec3_t closest_point = (normal_len_sq > 1e-9f)
+        ? vec3_sub(p, vec3_scale(normal, vec3_dot(vec3_sub(p, a), normal) / normal_len_sq))
+        : a; // Fallback for degenerate (line/point) triangle
+
+    // Check if the projected point is inside the triangle using barycentric coordinates
+    float u, v, w;
+    vec3_t v0 = vec3_sub(b, a), v1 = vec3_sub(c, a), v2 = vec3_sub(closest_point, a);
+    float d00 = vec3_length_sq(v0), d01 = vec3_dot(v0, v1), d11 = vec3_length_sq(v1);
+    float d20 = vec3_dot(v2, v0), d21 = vec3_dot(v2, v1);
+    float denom = d00 * d11 - d01 * d01;
+
+    // If triangle is degenerate, find closest point on its longest edge
+    if (fabs(denom) < 1e-9f) {
+        float ab_sq = vec3_length_sq(vec3_sub(b,a));
+        float bc_sq = vec3_length_sq(vec3_sub(c,b));
+        float ca_sq = vec3_length_sq(vec3_sub(a,c));
+        if (ab_sq >= bc_sq && ab_sq >= ca_sq) return find_closest_point_on_line_segment(p, a, b);
+        if (bc_sq >= ca_sq) return find_closest_point_on_line_segment(p, b, c);
+        return find_closest_point_on_line_segment(p, c, a);
+    }
+    
+    v = (d11 * d20 - d01 * d21) / denom;
+    w = (d00 * d21 - d01 * d20) / denom;
+    u = 1.0f - v - w;
+
+    if (u >= 0.0f && v >= 0.0f && w >= 0.0f) {
+        return closest_point; // The closest point is on the face of the triangle
+    }
+
+    // If not, the closest point is on one of the edges
+    vec3_t p_ab = find_closest_point_on_line_segment(p, a, b);
+    vec3_t p_bc = find_closest_point_on_line_segment(p, b, c);
+    vec3_t p_ca = find_closest_point_on_line_segment(p, c, a);
+
+    float d_ab_sq = vec3_length_sq(vec3_sub(p, p_ab));
+    float d_bc_sq = vec3_length_sq(vec3_sub(p, p_bc));
+    float d_ca_sq = vec3_length_sq(vec3_sub(p, p_ca));
+
+    if (d_ab_sq <= d_bc_sq && d_ab_sq <= d_ca_sq) {
+        return p_ab;
+    } else if (d_bc_sq <= d_ab_sq && d_bc_sq <= d_ca_sq) {
+        return p_bc;
+    } else {
+        return p_ca;
+    }
+}
+int check_sphere_world_collision(const scene_t* scene, vec3_t pos, float radius, vec3_t* out_normal, float* out_depth, int ignore_index) {
+    int collided = 0;
+    float max_penetration = 0.0f;
+
+    for (int i = 0; i < scene->object_count; i++) {
+        if (i == ignore_index) continue; // <-- ADD THIS CHECK
+        
+        scene_object_t* obj = scene->objects[i];
+        if (!obj->mesh || !obj->has_collision) continue;
+
+        mat4_t model_matrix = mat4_get_world_transform(scene, i);
+        mat4_t inv_model_matrix = mat4_inverse(model_matrix);
+
+        vec4_t sphere_center_local_4 = mat4_mul_vec4(inv_model_matrix, (vec4_t){pos.x, pos.y, pos.z, 1.0f});
+        vec3_t sphere_center_local = {sphere_center_local_4.x, sphere_center_local_4.y, sphere_center_local_4.z};
+        
+        float max_scale = fmax(obj->scale.x, fmax(obj->scale.y, obj->scale.z));
+        float scaled_radius = radius / max_scale;
+        float scaled_radius_sq = scaled_radius * scaled_radius;
+
+        for (int j = 0; j < obj->mesh->face_count; j++) {
+            int v0i = obj->mesh->faces[j * 3 + 0];
+            int v1i = obj->mesh->faces[j * 3 + 1];
+            int v2i = obj->mesh->faces[j * 3 + 2];
+
+            vec3_t v0 = obj->mesh->vertices[v0i];
+            vec3_t v1 = obj->mesh->vertices[v1i];
+            vec3_t v2 = obj->mesh->vertices[v2i];
+
+            vec3_t closest_point_local = find_closest_point_on_triangle(sphere_center_local, v0, v1, v2);
+
+            vec3_t delta = vec3_sub(sphere_center_local, closest_point_local);
+            float dist_sq = vec3_dot(delta, delta);
+
+            if (dist_sq < scaled_radius_sq) {
+                float dist = sqrtf(dist_sq);
+                float penetration = scaled_radius - dist;
+
+                if (penetration > max_penetration) {
+                    collided = 1;
+                    max_penetration = penetration;
+
+                    vec3_t normal_local = (dist > 1e-6) ? vec3_scale(delta, 1.0f / dist) : vec3_normalize(vec3_cross(vec3_sub(v1,v0), vec3_sub(v2,v0)));
+                    
+                    vec4_t normal_world_4 = mat4_mul_vec4(model_matrix, (vec4_t){normal_local.x, normal_local.y, normal_local.z, 0.0f});
+                    *out_normal = vec3_normalize((vec3_t){normal_world_4.x, normal_world_4.y, normal_world_4.z});
+                    
+                    *out_depth = penetration * max_scale;
+                }
+            }
+        }
+    }
+    return collided;
+}
+vec3_t collide_and_slide(const scene_t* scene, vec3_t pos, vec3_t vel, float radius, int ignore_index, int* out_on_ground) {
+    const int MAX_SLIDES = 4;
+    const float BOUNCE_FACTOR = 0.1f; 
+
+    // Initialize to not on ground at the start of the movement
+    *out_on_ground = 0;
+
+    for (int slide = 0; slide < MAX_SLIDES; slide++) {
+        vec3_t destination = vec3_add(pos, vel);
+
+        vec3_t collision_normal;
+        float penetration_depth;
+        if (!check_sphere_world_collision(scene, destination, radius, &collision_normal, &penetration_depth, ignore_index)) {
+            // No collision on this path, return the final destination
+            return destination; 
+        }
+
+        // A collision occurred, adjust position to be just outside the surface
+        pos = vec3_add(pos, vec3_scale(collision_normal, penetration_depth));
+        
+        // If the collision was with a walkable surface, set the ground flag.
+        // We check if the normal is pointing mostly upwards.
+        if (collision_normal.z > 0.7f) {
+            *out_on_ground = 1;
+        }
+
+        // Project the velocity onto the collision plane to get the "slide" vector
+        float dot_product = vec3_dot(vel, collision_normal);
+        vec3_t slide_vel = vec3_sub(vel, vec3_scale(collision_normal, dot_product));
+        
+        // Add a small bounce to prevent getting stuck in crevices
+        vec3_t bounce_vel = vec3_scale(collision_normal, -dot_product * BOUNCE_FACTOR);
+
+        // The new velocity for the next iteration is the slide plus the bounce
+        vel = vec3_add(slide_vel, bounce_vel);
+    }
+
+    // If we finished all slide iterations, it means we're likely stuck. Return the last safe position.
+    return pos;
+}
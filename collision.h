@@ -0,0 +1,14 @@
+// collision.h
+// Ray and sphere queries against the triangles of a scene's has_collision objects.
+
+#ifndef COLLISION_H
+#define COLLISION_H
+#include "math3d.h"
+
+// ignore_index skips one object (the player's own model), -1 for none
+int raycast_scene(const scene_t* scene, vec3_t ray_origin, vec3_t ray_dir, float max_dist, float* hit_dist, vec3_t* hit_normal, int ignore_index);
+int check_sphere_world_collision(const scene_t* scene, vec3_t pos, float radius, vec3_t* out_normal, float* out_depth, int ignore_index);
+// Moves a sphere by vel, sliding along whatever it hits; out_on_ground is set when it touched a walkable surface
+vec3_t collide_and_slide(const scene_t* scene, vec3_t pos, vec3_t vel, float radius, int ignore_index, int* out_on_ground);
+
+#endif // COLLISION_H
@@ -0,0 +1,504 @@
+// lod.c
+// Mesh simplification (quadric error metrics with a lazy min-heap of edge collapses) and
+// per-object LOD selection.
+
+#include "lod.h"
+#include "scene.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define LOD_BOUNDARY_WEIGHT 100.0 // How hard boundary edges resist moving, relative to face planes
+#define LOD_STALL_RATIO 0.9f      // A level that keeps more than 90% of the previous one's faces ends the chain
+
+typedef struct {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2; // Sum of plane outer products (a, b, c, d)
+} quadric_t;
+
+typedef struct {
+    double cost;
+    int keep, remove;            // Collapse remove into keep
+    int keep_stamp, remove_stamp; // Vertex stamps when queued; stale once either vertex changed
+    vec3_t target;               // Where keep ends up
+} lod_collapse_t;
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} lod_face_list_t;
+
+typedef struct {
+    int vertex_count;
+    vec3_t* positions;
+    quadric_t* quadrics;
+    int* stamps;
+    unsigned char* vertex_alive;
+    lod_face_list_t* vertex_faces; // Faces around each vertex; may hold faces that have since died
+    int* faces;                    // 3 per face, rewritten as vertices merge
+    unsigned char* face_alive;
+    int face_count;
+    int alive_face_count;
+    lod_collapse_t* heap;
+    int heap_count;
+    int heap_capacity;
+    int* marks;                    // Scratch for neighborhood tests
+    int mark_token;
+} lod_simplifier_t;
+
+typedef struct {
+    int v1, v2, face;
+} lod_edge_t;
+
+// --- Function Declarations ---
+static void quadric_add_plane(quadric_t* q, double a, double b, double c, double d, double weight);
+static void quadric_add(quadric_t* q, const quadric_t* other);
+static double quadric_error(const quadric_t* q, vec3_t p);
+static int lod_heap_push(lod_simplifier_t* s, lod_collapse_t collapse);
+static lod_collapse_t lod_heap_pop(lod_simplifier_t* s);
+static int lod_face_list_add(lod_face_list_t* list, int face);
+static int lod_queue_edge(lod_simplifier_t* s, int keep, int remove);
+static int lod_collapse_allowed(lod_simplifier_t* s, const lod_collapse_t* collapse);
+static int lod_apply_collapse(lod_simplifier_t* s, const lod_collapse_t* collapse);
+static int lod_simplifier_init(lod_simplifier_t* s, const mesh_t* mesh);
+static void lod_simplifier_free(lod_simplifier_t* s);
+static mesh_t* lod_simplifier_output(const lod_simplifier_t* s);
+
+// --- Quadrics ---
+static void quadric_add_plane(quadric_t* q, double a, double b, double c, double d, double weight) {
+    q->a2 += weight * a * a; q->ab += weight * a * b; q->ac += weight * a * c; q->ad += weight * a * d;
+    q->b2 += weight * b * b; q->bc += weight * b * c; q->bd += weight * b * d;
+    q->c2 += weight * c * c; q->cd += weight * c * d;
+    q->d2 += weight * d * d;
+}
+
+static void quadric_add(quadric_t* q, const quadric_t* other) {
+    q->a2 += other->a2; q->ab += other->ab; q->ac += other->ac; q->ad += other->ad;
+    q->b2 += other->b2; q->bc += other->bc; q->bd += other->bd;
+    q->c2 += other->c2; q->cd += other->cd;
+    q->d2 += other->d2;
+}
+
+// Weighted sum of squared distances from p to every plane in the quadric
+static double quadric_error(const quadric_t* q, vec3_t p) {
+    double x = p.x, y = p.y, z = p.z;
+    return q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x
+         + q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y
+         + q->c2 * z * z + 2.0 * q->cd * z
+         + q->d2;
+}
+
+// --- Collapse Queue ---
+static int lod_heap_push(lod_simplifier_t* s, lod_collapse_t collapse) {
+    if (s->heap_count >= s->heap_capacity) {
+        int new_capacity = (s->heap_capacity == 0) ? 1024 : s->heap_capacity * 2;
+        lod_collapse_t* new_heap = (lod_collapse_t*)realloc(s->heap, new_capacity * sizeof(lod_collapse_t));
+        if (!new_heap) return 0;
+        s->heap = new_heap;
+        s->heap_capacity = new_capacity;
+    }
+    int i = s->heap_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (s->heap[parent].cost <= collapse.cost) break;
+        s->heap[i] = s->heap[parent];
+        i = parent;
+    }
+    s->heap[i] = collapse;
+    return 1;
+}
+
+static lod_collapse_t lod_heap_pop(lod_simplifier_t* s) {
+    lod_collapse_t top = s->heap[0];
+    lod_collapse_t last = s->heap[--s->heap_count];
+    int i = 0;
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= s->heap_count) break;
+        if (child + 1 < s->heap_count && s->heap[child + 1].cost < s->heap[child].cost) child++;
+        if (last.cost <= s->heap[child].cost) break;
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+    if (s->heap_count > 0) s->heap[i] = last;
+    return top;
+}
+
+static int lod_face_list_add(lod_face_list_t* list, int face) {
+    if (list->count >= list->capacity) {
+        int new_capacity = (list->capacity == 0) ? 8 : list->capacity * 2;
+        int* new_items = (int*)realloc(list->items, new_capacity * sizeof(int));
+        if (!new_items) return 0;
+        list->items = new_items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count++] = face;
+    return 1;
+}
+
+// Queues the cheaper of collapsing into either endpoint or their midpoint
+static int lod_queue_edge(lod_simplifier_t* s, int keep, int remove) {
+    quadric_t q = s->quadrics[keep];
+    quadric_add(&q, &s->quadrics[remove]);
+    vec3_t candidates[3] = {
+        s->positions[keep],
+        s->positions[remove],
+        vec3_scale(vec3_add(s->positions[keep], s->positions[remove]), 0.5f)
+    };
+    lod_collapse_t collapse;
+    collapse.cost = quadric_error(&q, candidates[0]);
+    collapse.target = candidates[0];
+    for (int i = 1; i < 3; i++) {
+        double cost = quadric_error(&q, candidates[i]);
+        if (cost < collapse.cost) {
+            collapse.cost = cost;
+            collapse.target = candidates[i];
+        }
+    }
+    collapse.keep = keep;
+    collapse.remove = remove;
+    collapse.keep_stamp = s->stamps[keep];
+    collapse.remove_stamp = s->stamps[remove];
+    return lod_heap_push(s, collapse);
+}
+
+// --- Collapse ---
+// Rejects collapses that would make the surface non-manifold (the endpoints share a neighbor
+// that is not opposite the edge) or turn any surviving face over.
+static int lod_collapse_allowed(lod_simplifier_t* s, const lod_collapse_t* collapse) {
+    int keep = collapse->keep, remove = collapse->remove;
+
+    // Link condition: common neighbors must be exactly the faces' opposite vertices
+    int token = s->mark_token;
+    s->mark_token += 2;
+    const lod_face_list_t* keep_faces = &s->vertex_faces[keep];
+    const lod_face_list_t* remove_faces = &s->vertex_faces[remove];
+    for (int i = 0; i < keep_faces->count; i++) {
+        int f = keep_faces->items[i];
+        if (!s->face_alive[f]) continue;
+        for (int k = 0; k < 3; k++) s->marks[s->faces[f * 3 + k]] = token;
+    }
+    int shared_faces = 0, common_neighbors = 0;
+    for (int i = 0; i < remove_faces->count; i++) {
+        int f = remove_faces->items[i];
+        if (!s->face_alive[f]) continue;
+        const int* face = &s->faces[f * 3];
+        if (face[0] == keep || face[1] == keep || face[2] == keep) shared_faces++;
+        for (int k = 0; k < 3; k++) {
+            int n = face[k];
+            if (n == keep || n == remove || s->marks[n] != token) continue;
+            s->marks[n] = token + 1; // Count each neighbor once
+            common_neighbors++;
+        }
+    }
+    if (shared_faces == 0 || common_neighbors != shared_faces) return 0;
+
+    // Orientation: every face that survives must keep facing the same way, give or take
+    // about 78 degrees, so small turns cannot add up to a flip over many collapses
+    for (int side = 0; side < 2; side++) {
+        int moved = side ? remove : keep;
+        const lod_face_list_t* list = &s->vertex_faces[moved];
+        for (int i = 0; i < list->count; i++) {
+            int f = list->items[i];
+            if (!s->face_alive[f]) continue;
+            const int* face = &s->faces[f * 3];
+            if ((face[0] == keep || face[1] == keep || face[2] == keep) &&
+                (face[0] == remove || face[1] == remove || face[2] == remove)) continue; // Collapses away
+            vec3_t p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = s->positions[face[k]];
+                q[k] = (face[k] == moved) ? collapse->target : p[k];
+            }
+            vec3_t before = vec3_cross(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+            vec3_t after = vec3_cross(vec3_sub(q[1], q[0]), vec3_sub(q[2], q[0]));
+            if (vec3_dot(before, after) <= 0.2f * vec3_length(before) * vec3_length(after)) return 0;
+        }
+    }
+    return 1;
+}
+
+// Returns 0 if out of memory (the mesh is still consistent, just not simplified further)
+static int lod_apply_collapse(lod_simplifier_t* s, const lod_collapse_t* collapse) {
+    int keep = collapse->keep, remove = collapse->remove;
+    s->positions[keep] = collapse->target;
+    quadric_add(&s->quadrics[keep], &s->quadrics[remove]);
+    s->vertex_alive[remove] = 0;
+    s->stamps[keep]++;
+    s->stamps[remove]++;
+
+    lod_face_list_t* remove_faces = &s->vertex_faces[remove];
+    for (int i = 0; i < remove_faces->count; i++) {
+        int f = remove_faces->items[i];
+        if (!s->face_alive[f]) continue;
+        int* face = &s->faces[f * 3];
+        if (face[0] == keep || face[1] == keep || face[2] == keep) {
+            s->face_alive[f] = 0; // The edge's own faces
+            s->alive_face_count--;
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (face[k] == remove) face[k] = keep;
+        }
+        if (!lod_face_list_add(&s->vertex_faces[keep], f)) return 0;
+    }
+    free(remove_faces->items);
+    remove_faces->items = NULL;
+    remove_faces->count = remove_faces->capacity = 0;
+
+    // Drop dead faces from the kept vertex's list and requeue its edges at their new cost
+    lod_face_list_t* keep_faces = &s->vertex_faces[keep];
+    int token = s->mark_token++;
+    int live = 0;
+    for (int i = 0; i < keep_faces->count; i++) {
+        int f = keep_faces->items[i];
+        if (!s->face_alive[f]) continue;
+        keep_faces->items[live++] = f;
+        for (int k = 0; k < 3; k++) {
+            int n = s->faces[f * 3 + k];
+            if (n == keep || s->marks[n] == token) continue;
+            s->marks[n] = token;
+            if (!lod_queue_edge(s, keep, n)) return 0;
+        }
+    }
+    keep_faces->count = live;
+    return 1;
+}
+
+// --- Setup ---
+static int compare_lod_edges(const void* a, const void* b) {
+    const lod_edge_t* ea = (const lod_edge_t*)a;
+    const lod_edge_t* eb = (const lod_edge_t*)b;
+    if (ea->v1 != eb->v1) return (ea->v1 < eb->v1) ? -1 : 1;
+    return (ea->v2 < eb->v2) ? -1 : (ea->v2 > eb->v2) ? 1 : 0;
+}
+
+static int lod_simplifier_init(lod_simplifier_t* s, const mesh_t* mesh) {
+    memset(s, 0, sizeof(*s));
+    int vc = mesh->vertex_count, fc = mesh->face_count;
+    s->vertex_count = vc;
+    s->face_count = fc;
+    s->positions = (vec3_t*)malloc(vc * sizeof(vec3_t));
+    s->quadrics = (quadric_t*)calloc(vc, sizeof(quadric_t));
+    s->stamps = (int*)calloc(vc, sizeof(int));
+    s->vertex_alive = (unsigned char*)malloc(vc);
+    s->vertex_faces = (lod_face_list_t*)calloc(vc, sizeof(lod_face_list_t));
+    s->marks = (int*)calloc(vc, sizeof(int));
+    s->faces = (int*)malloc(fc * 3 * sizeof(int));
+    s->face_alive = (unsigned char*)malloc(fc);
+    lod_edge_t* edges = (lod_edge_t*)malloc(fc * 3 * sizeof(lod_edge_t));
+    if (!s->positions || !s->quadrics || !s->stamps || !s->vertex_alive || !s->vertex_faces || !s->marks ||
+        !s->faces || !s->face_alive || !edges) {
+        free(edges);
+        return 0;
+    }
+    memcpy(s->positions, mesh->vertices, vc * sizeof(vec3_t));
+    memcpy(s->faces, mesh->faces, fc * 3 * sizeof(int));
+    memset(s->vertex_alive, 1, vc);
+    s->mark_token = 1;
+
+    // Face planes, weighted by area, go into the quadrics of their corners
+    int edge_count = 0;
+    for (int f = 0; f < fc; f++) {
+        const int* face = &s->faces[f * 3];
+        s->face_alive[f] = 0;
+        if (face[0] < 0 || face[0] >= vc || face[1] < 0 || face[1] >= vc || face[2] < 0 || face[2] >= vc) continue;
+        if (face[0] == face[1] || face[1] == face[2] || face[2] == face[0]) continue;
+        s->face_alive[f] = 1;
+        s->alive_face_count++;
+
+        vec3_t v0 = s->positions[face[0]], v1 = s->positions[face[1]], v2 = s->positions[face[2]];
+        vec3_t n = vec3_cross(vec3_sub(v1, v0), vec3_sub(v2, v0));
+        float len = vec3_length(n);
+        if (len > 0.0f) {
+            n = vec3_scale(n, 1.0f / len);
+            double d = -vec3_dot(n, v0);
+            for (int k = 0; k < 3; k++) quadric_add_plane(&s->quadrics[face[k]], n.x, n.y, n.z, d, 0.5 * len);
+        }
+        for (int k = 0; k < 3; k++) {
+            if (!lod_face_list_add(&s->vertex_faces[face[k]], f)) {
+                free(edges);
+                return 0;
+            }
+            int a = face[k], b = face[(k + 1) % 3];
+            edges[edge_count++] = (lod_edge_t){(a < b) ? a : b, (a < b) ? b : a, f};
+        }
+    }
+
+    // Unique edges; those with a single face are boundaries and get a plane through the
+    // edge at right angles to the face, which keeps the outline from shrinking
+    qsort(edges, edge_count, sizeof(lod_edge_t), compare_lod_edges);
+    for (int i = 0; i < edge_count;) {
+        int j = i + 1;
+        while (j < edge_count && edges[j].v1 == edges[i].v1 && edges[j].v2 == edges[i].v2) j++;
+        int a = edges[i].v1, b = edges[i].v2;
+        if (j - i == 1) {
+            const int* face = &s->faces[edges[i].face * 3];
+            vec3_t v0 = s->positions[face[0]], v1 = s->positions[face[1]], v2 = s->positions[face[2]];
+            vec3_t face_normal = vec3_cross(vec3_sub(v1, v0), vec3_sub(v2, v0));
+            vec3_t edge = vec3_sub(s->positions[b], s->positions[a]);
+            vec3_t n = vec3_cross(edge, face_normal);
+            float len = vec3_length(n);
+            if (len > 0.0f) {
+                n = vec3_scale(n, 1.0f / len);
+                double d = -vec3_dot(n, s->positions[a]);
+                double weight = LOD_BOUNDARY_WEIGHT * vec3_length_sq(edge);
+                quadric_add_plane(&s->quadrics[a], n.x, n.y, n.z, d, weight);
+                quadric_add_plane(&s->quadrics[b], n.x, n.y, n.z, d, weight);
+            }
+        }
+        i = j;
+    }
+    for (int i = 0; i < edge_count; i++) {
+        if (i > 0 && edges[i].v1 == edges[i - 1].v1 && edges[i].v2 == edges[i - 1].v2) continue;
+        if (!lod_queue_edge(s, edges[i].v1, edges[i].v2)) {
+            free(edges);
+            return 0;
+        }
+    }
+    free(edges);
+    return 1;
+}
+
+static void lod_simplifier_free(lod_simplifier_t* s) {
+    if (s->vertex_faces) {
+        for (int i = 0; i < s->vertex_count; i++) free(s->vertex_faces[i].items);
+    }
+    free(s->positions);
+    free(s->quadrics);
+    free(s->stamps);
+    free(s->vertex_alive);
+    free(s->vertex_faces);
+    free(s->marks);
+    free(s->faces);
+    free(s->face_alive);
+    free(s->heap);
+}
+
+// Copies the surviving faces and the vertices they use into a new mesh
+static mesh_t* lod_simplifier_output(const lod_simplifier_t* s) {
+    mesh_t* mesh = (mesh_t*)calloc(1, sizeof(mesh_t));
+    int* remap = (int*)malloc(s->vertex_count * sizeof(int));
+    if (!mesh || !remap) {
+        free(mesh);
+        free(remap);
+        return NULL;
+    }
+    for (int i = 0; i < s->vertex_count; i++) remap[i] = -1;
+    for (int f = 0; f < s->face_count; f++) {
+        if (!s->face_alive[f]) continue;
+        for (int k = 0; k < 3; k++) {
+            int v = s->faces[f * 3 + k];
+            if (remap[v] < 0) remap[v] = mesh->vertex_count++;
+        }
+        mesh->face_count++;
+    }
+    mesh->vertices = (vec3_t*)malloc((mesh->vertex_count > 0 ? mesh->vertex_count : 1) * sizeof(vec3_t));
+    mesh->faces = (int*)malloc((mesh->face_count > 0 ? mesh->face_count : 1) * 3 * sizeof(int));
+    if (!mesh->vertices || !mesh->faces) {
+        free(remap);
+        destroy_mesh_data(mesh);
+        return NULL;
+    }
+    for (int i = 0; i < s->vertex_count; i++) {
+        if (remap[i] >= 0) mesh->vertices[remap[i]] = s->positions[i];
+    }
+    int out = 0;
+    for (int f = 0; f < s->face_count; f++) {
+        if (!s->face_alive[f]) continue;
+        for (int k = 0; k < 3; k++) mesh->faces[out * 3 + k] = remap[s->faces[f * 3 + k]];
+        out++;
+    }
+    free(remap);
+    mesh_calculate_normals(mesh);
+    return mesh;
+}
+
+// --- Simplification ---
+mesh_t* mesh_simplify(const mesh_t* mesh, int target_face_count) {
+    if (!mesh || mesh->vertex_count == 0 || mesh->face_count == 0) return NULL;
+    lod_simplifier_t s;
+    mesh_t* result = NULL;
+    if (lod_simplifier_init(&s, mesh)) {
+        while (s.alive_face_count > target_face_count && s.heap_count > 0) {
+            lod_collapse_t collapse = lod_heap_pop(&s);
+            if (!s.vertex_alive[collapse.keep] || !s.vertex_alive[collapse.remove]) continue;
+            if (s.stamps[collapse.keep] != collapse.keep_stamp || s.stamps[collapse.remove] != collapse.remove_stamp) continue;
+            if (!lod_collapse_allowed(&s, &collapse)) continue; // Requeued if a neighbor's collapse changes it
+            if (!lod_apply_collapse(&s, &collapse)) break;
+        }
+        result = lod_simplifier_output(&s);
+    }
+    lod_simplifier_free(&s);
+    return result;
+}
+
+// --- Object LODs ---
+int scene_object_generate_lods(scene_object_t* object) {
+    scene_object_free_lods(object);
+    if (!object->mesh || object->light_properties) return 0;
+
+    int face_count = object->mesh->face_count;
+    while (object->lod_count < MAX_LOD_LEVELS) {
+        int target = (int)(face_count * LOD_FACE_RATIO);
+        if (target < LOD_MIN_FACES) break;
+        // Always from the original, so errors do not pile up level after level
+        mesh_t* lod = mesh_simplify(object->mesh, target);
+        if (!lod) break;
+        if (lod->face_count > face_count * LOD_STALL_RATIO) {
+            destroy_mesh_data(lod); // Nothing left that can collapse without damage
+            break;
+        }
+        object->lods[object->lod_count++] = lod;
+        face_count = lod->face_count;
+    }
+    return object->lod_count;
+}
+
+int scene_object_add_lod(scene_object_t* object, mesh_t* mesh) {
+    if (!mesh || object->lod_count >= MAX_LOD_LEVELS) return 0;
+    object->lods[object->lod_count++] = mesh;
+    return 1;
+}
+
+void scene_object_free_lods(scene_object_t* object) {
+    for (int i = 0; i < object->lod_count; i++) {
+        destroy_mesh_data(object->lods[i]);
+        object->lods[i] = NULL;
+    }
+    object->lod_count = 0;
+    object->lod_level = 0;
+}
+
+// --- Selection ---
+int scene_object_select_lod(scene_object_t* object, mat4_t world, mat4_t view_projection, float projection_y_scale) {
+    if (object->lod_count == 0 || !object->mesh) {
+        object->lod_level = 0;
+        return 0;
+    }
+    vec3_t center;
+    float radius;
+    mesh_world_sphere(object->mesh, world, &center, &radius);
+    const float* w_row = view_projection.m[3];
+    float w = w_row[0] * center.x + w_row[1] * center.y + w_row[2] * center.z + w_row[3];
+
+    int level = object->lod_level;
+    level = (level < 0) ? 0 : (level > object->lod_count) ? object->lod_count : level;
+    if (w <= radius) {
+        level = 0; // The eye is in or next to the sphere
+    } else {
+        // Fraction of the view height covered by the sphere's diameter
+        float size = radius * fabsf(projection_y_scale) / w;
+        float switch_size = LOD_SWITCH_SIZE; // Below this, level + 1 takes over from level
+        for (int i = 0; i < level; i++) switch_size *= 0.5f;
+        while (level < object->lod_count && size < switch_size * (1.0f - LOD_HYSTERESIS)) {
+            level++;
+            switch_size *= 0.5f;
+        }
+        while (level > 0 && size > switch_size * 2.0f * (1.0f + LOD_HYSTERESIS)) {
+            level--;
+            switch_size *= 2.0f;
+        }
+    }
+    object->lod_level = level;
+    return level;
+}
@@ -0,0 +1,29 @@
+// lod.h
+// Level of detail: edge-collapse simplification that builds an object's chain of coarser
+// meshes, and the screen-size rule that picks which one to draw.
+
+#ifndef LOD_H
+#define LOD_H
+#include "math3d.h"
+
+#define LOD_MIN_FACES 64     // Meshes with fewer faces get no LODs, and a chain stops before going below it
+#define LOD_FACE_RATIO 0.5f  // Each generated level keeps about half the faces of the one before
+#define LOD_SWITCH_SIZE 0.4f // Level 1 once the bounding sphere spans less than 40% of the view height, level 2 below 20%, ...
+#define LOD_HYSTERESIS 0.15f // A level changes only when the size is 15% past a switch size, so objects near one do not flicker
+
+// Quadric-error edge collapse down to about target_face_count faces. Boundary edges are
+// weighted so open meshes keep their outline, and collapses that would flip a face or
+// pinch the surface are skipped. Returns a new mesh with normals, or NULL if out of memory.
+mesh_t* mesh_simplify(const mesh_t* mesh, int target_face_count);
+// Replaces the object's LODs with levels generated from its mesh; returns how many were made
+int scene_object_generate_lods(scene_object_t* object);
+// Appends a mesh the caller built (or copied) as the next coarser level; takes ownership.
+// Returns 0 if the chain is full.
+int scene_object_add_lod(scene_object_t* object, mesh_t* mesh);
+void scene_object_free_lods(scene_object_t* object);
+// Level to draw this frame (0 = the object's own mesh, n = lods[n - 1]) from the projected
+// size of the mesh's bounding sphere; projection_y_scale is the projection's m[1][1].
+// Stores the result in the object's lod_level, which is where the hysteresis starts from.
+int scene_object_select_lod(scene_object_t* object, mat4_t world, mat4_t view_projection, float projection_y_scale);
+
+#endif // LOD_H
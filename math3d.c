@@ -3,6 +3,7 @@
 
 #include "math3d.h"
 #include <math.h>
+#include <stdlib.h>
 
 // --- Original Matrix Functions ---
 
@@ -294,3 +295,232 @@ vec3_t vec3_scale(vec3_t v, float s) {
 float vec3_length(vec3_t v) {
     return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
 }
+
+// --- Bounds and Culling ---
+void mesh_update_bounds(mesh_t* mesh) {
+    if (!mesh || mesh->bounds_valid) return;
+    vec3_t min_v = {0, 0, 0}, max_v = {0, 0, 0};
+    if (mesh->vertex_count > 0) {
+        min_v = max_v = mesh->vertices[0];
+        for (int i = 1; i < mesh->vertex_count; i++) {
+            vec3_t v = mesh->vertices[i];
+            min_v.x = (v.x < min_v.x) ? v.x : min_v.x;
+            max_v.x = (v.x > max_v.x) ? v.x : max_v.x;
+            min_v.y = (v.y < min_v.y) ? v.y : min_v.y;
+            max_v.y = (v.y > max_v.y) ? v.y : max_v.y;
+            min_v.z = (v.z < min_v.z) ? v.z : min_v.z;
+            max_v.z = (v.z > max_v.z) ? v.z : max_v.z;
+        }
+    }
+    // Second pass for the radius: the farthest vertex is usually well inside the box's corners
+    vec3_t center = vec3_scale(vec3_add(min_v, max_v), 0.5f);
+    float radius_sq = 0.0f;
+    for (int i = 0; i < mesh->vertex_count; i++) {
+        float d = vec3_length_sq(vec3_sub(mesh->vertices[i], center));
+        if (d > radius_sq) radius_sq = d;
+    }
+    mesh->bounds_min = min_v;
+    mesh->bounds_max = max_v;
+    mesh->bounds_center = center;
+    mesh->bounds_radius = sqrtf(radius_sq);
+    mesh->bounds_valid = 1;
+}
+
+void mesh_invalidate_bounds(mesh_t* mesh) {
+    if (mesh) mesh->bounds_valid = 0;
+    mesh_invalidate_vertex_streams(mesh);
+}
+
+void mesh_world_sphere(mesh_t* mesh, mat4_t world, vec3_t* center, float* radius) {
+    vec3_t local_center = {0, 0, 0};
+    float local_radius = 0.0f;
+    if (mesh) {
+        mesh_update_bounds(mesh);
+        local_center = mesh->bounds_center;
+        local_radius = mesh->bounds_radius;
+    }
+    vec4_t world_center = mat4_mul_vec4(world, (vec4_t){local_center.x, local_center.y, local_center.z, 1.0f});
+    float axis_scale = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        float len = vec3_length((vec3_t){world.m[0][c], world.m[1][c], world.m[2][c]});
+        if (len > axis_scale) axis_scale = len;
+    }
+    *center = (vec3_t){world_center.x, world_center.y, world_center.z};
+    *radius = local_radius * axis_scale;
+}
+
+static vec4_t frustum_normalize_plane(vec4_t plane) {
+    float len = vec3_length((vec3_t){plane.x, plane.y, plane.z});
+    if (len > 1e-12f) { // Zero for the near plane of an orthographic projection, which then culls nothing
+        float inv_len = 1.0f / len;
+        plane.x *= inv_len; plane.y *= inv_len; plane.z *= inv_len; plane.w *= inv_len;
+    }
+    return plane;
+}
+
+// Gribb/Hartmann: a side plane is the w row of the view-projection matrix plus or minus its
+// x or y row, and a view-space plane maps to world space through the rows of the view matrix
+frustum_t frustum_from_camera(mat4_t view, mat4_t projection, float far_distance) {
+    mat4_t m = mat4_mul_mat4(projection, view);
+    frustum_t frustum;
+    for (int p = 0; p < 4; p++) {
+        int row = p / 2;                        // Left, right: -w <= x <= w; bottom, top likewise in y
+        float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        frustum.planes[p] = frustum_normalize_plane((vec4_t){
+            m.m[3][0] + sign * m.m[row][0],
+            m.m[3][1] + sign * m.m[row][1],
+            m.m[3][2] + sign * m.m[row][2],
+            m.m[3][3] + sign * m.m[row][3]
+        });
+    }
+    frustum.planes[4] = frustum_normalize_plane((vec4_t){m.m[3][0], m.m[3][1], m.m[3][2], m.m[3][3]}); // w >= 0
+    frustum.planes[5] = frustum_normalize_plane((vec4_t){                                              // view z + far >= 0
+        view.m[2][0] + far_distance * view.m[3][0],
+        view.m[2][1] + far_distance * view.m[3][1],
+        view.m[2][2] + far_distance * view.m[3][2],
+        view.m[2][3] + far_distance * view.m[3][3]
+    });
+    return frustum;
+}
+
+int frustum_test_mesh(const frustum_t* frustum, mesh_t* mesh, mat4_t world) {
+    if (!mesh) return 1;
+    vec3_t center;
+    float radius;
+    mesh_world_sphere(mesh, world, &center, &radius);
+    for (int p = 0; p < 6; p++) {
+        const vec4_t* plane = &frustum->planes[p];
+        if (plane->x * center.x + plane->y * center.y + plane->z * center.z + plane->w < -radius) return 0;
+    }
+
+    // World box around the transformed local box: its half extent on each axis is the
+    // local half extents weighted by the absolute values of the matrix
+    vec3_t local_center = mesh->bounds_center;
+    vec3_t local_extent = vec3_scale(vec3_sub(mesh->bounds_max, mesh->bounds_min), 0.5f);
+    vec4_t box_center4 = mat4_mul_vec4(world, (vec4_t){local_center.x, local_center.y, local_center.z, 1.0f});
+    float extent[3];
+    for (int r = 0; r < 3; r++) {
+        extent[r] = fabsf(world.m[r][0]) * local_extent.x + fabsf(world.m[r][1]) * local_extent.y + fabsf(world.m[r][2]) * local_extent.z;
+    }
+    for (int p = 0; p < 6; p++) {
+        const vec4_t* plane = &frustum->planes[p];
+        float distance = plane->x * box_center4.x + plane->y * box_center4.y + plane->z * box_center4.z + plane->w;
+        float reach = fabsf(plane->x) * extent[0] + fabsf(plane->y) * extent[1] + fabsf(plane->z) * extent[2];
+        if (distance < -reach) return 0;
+    }
+    return 1;
+}
+
+float light_influence_radius(const light_t* light) {
+    return (light->intensity > 0.0f) ? sqrtf(light->intensity / LIGHT_CUTOFF) : 0.0f;
+}
+
+light_reach_t light_reach(const light_t* light, vec3_t position, vec3_t direction) {
+    light_reach_t reach;
+    reach.position = position;
+    reach.direction = direction;
+    reach.radius = light_influence_radius(light);
+    reach.is_spot = (light->type == LIGHT_TYPE_SPOT);
+    reach.cos_outer = reach.is_spot ? cosf(light->spot_angle / 2.0f) : -1.0f;
+    reach.sin_outer = reach.is_spot ? sinf(light->spot_angle / 2.0f) : 0.0f;
+    return reach;
+}
+
+// 0 only if no point of the sphere is within the light's radius (and, for spotlights, inside
+// its cone): the sphere hides an angle of asin(radius / distance) around its center's
+// direction, so it touches the cone when that direction is within the half angle plus that.
+int light_reaches_sphere(const light_reach_t* reach, vec3_t center, float radius) {
+    vec3_t to_center = vec3_sub(center, reach->position);
+    float distance = vec3_length(to_center);
+    if (distance - radius > reach->radius) return 0;
+    if (!reach->is_spot || distance <= radius || reach->cos_outer <= 0.0f) {
+        return 1; // The cones of 180 degrees and wider are not worth testing
+    }
+    float sin_spread = radius / distance;
+    float cos_spread = sqrtf(1.0f - sin_spread * sin_spread);
+    float cos_limit = reach->cos_outer * cos_spread - reach->sin_outer * sin_spread; // cos(half angle + spread)
+    return vec3_dot(to_center, reach->direction) >= cos_limit * distance;
+}
+
+// --- Vertex Streams ---
+int mesh_stream_stride(const mesh_t* mesh) {
+    return (mesh->vertex_count + 3) & ~3;
+}
+
+const float* mesh_vertex_streams(mesh_t* mesh) {
+    if (mesh->vertex_streams || !mesh->normals || mesh->vertex_count <= 0) return mesh->vertex_streams;
+    int stride = mesh_stream_stride(mesh);
+    float* streams = (float*)calloc(6 * (size_t)stride, sizeof(float));
+    if (!streams) return NULL;
+    for (int i = 0; i < mesh->vertex_count; i++) {
+        streams[i] = mesh->vertices[i].x;
+        streams[stride + i] = mesh->vertices[i].y;
+        streams[2 * stride + i] = mesh->vertices[i].z;
+        streams[3 * stride + i] = mesh->normals[i].x;
+        streams[4 * stride + i] = mesh->normals[i].y;
+        streams[5 * stride + i] = mesh->normals[i].z;
+    }
+    mesh->vertex_streams = streams;
+    return streams;
+}
+
+void mesh_invalidate_vertex_streams(mesh_t* mesh) {
+    if (!mesh) return;
+    free(mesh->vertex_streams);
+    mesh->vertex_streams = NULL;
+}
+
+// --- Scene Ordering ---
+// Distance from the eye to the object's world-space bounding sphere (negative when the
+// eye is inside it), from the mesh's cached sphere scaled by the largest axis of the
+// world transform.
+float scene_object_bounds_distance(const scene_t* scene, int object_index, vec3_t eye) {
+    vec3_t center;
+    float radius;
+    mesh_world_sphere(scene->objects[object_index]->mesh, mat4_get_world_transform(scene, object_index), &center, &radius);
+    return vec3_length(vec3_sub(center, eye)) - radius;
+}
+
+// Sorts scene objects by distance to their bounds, nearest first. Insertion sort on the
+// previous frame's order: it is nearly sorted already, so this is close to linear.
+void draw_order_update(draw_order_t* order, const scene_t* scene, vec3_t eye) {
+    if (order->count != scene->object_count) {
+        if (scene->object_count > order->capacity) {
+            int* new_indices = (int*)realloc(order->indices, scene->object_count * sizeof(int));
+            if (new_indices) order->indices = new_indices;
+            float* new_distances = (float*)realloc(order->distances, scene->object_count * sizeof(float));
+            if (new_distances) order->distances = new_distances;
+            if (!new_indices || !new_distances) {
+                order->count = 0;
+                return;
+            }
+            order->capacity = scene->object_count;
+        }
+        // Objects were added or removed: start over from array order
+        order->count = scene->object_count;
+        for (int i = 0; i < order->count; i++) order->indices[i] = i;
+    }
+
+    for (int i = 0; i < order->count; i++) {
+        order->distances[i] = scene_object_bounds_distance(scene, i, eye);
+    }
+    for (int i = 1; i < order->count; i++) {
+        int index = order->indices[i];
+        float distance = order->distances[index];
+        int j = i - 1;
+        while (j >= 0 && order->distances[order->indices[j]] > distance) {
+            order->indices[j + 1] = order->indices[j];
+            j--;
+        }
+        order->indices[j + 1] = index;
+    }
+}
+
+void draw_order_free(draw_order_t* order) {
+    free(order->indices);
+    free(order->distances);
+    order->indices = NULL;
+    order->distances = NULL;
+    order->count = 0;
+    order->capacity = 0;
+}
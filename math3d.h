@@ -2,11 +2,11 @@
 
 #ifndef MATH3D_H
 #define MATH3D_H
-#include <windows.h>
 // --- Structures ---
 typedef struct { float x, y, z; } vec3_t;
 typedef struct { float x, y, z, w; } vec4_t;
 typedef struct { float m[4][4]; } mat4_t;
+typedef struct { int left, top, right, bottom; } rect_t; // Window pixels, right/bottom exclusive
 typedef enum {
     LIGHT_TYPE_POINT,
     LIGHT_TYPE_SPOT
@@ -25,13 +25,34 @@ typedef struct {
     float spot_angle; // The full angle of the cone in radians
     float spot_blend; // 0 = hard edge, 1 = smooth falloff to the edge
 } light_t;
+#define LIGHT_CUTOFF (1.0f / 256.0f) // Attenuation below which a light is taken to add nothing (under one 8-bit step)
+typedef struct {
+    vec3_t position;
+    vec3_t direction;   // Spotlights: the cone's axis
+    float radius;       // See light_influence_radius()
+    float cos_outer;    // Spotlights: cosine and sine of the cone's half angle
+    float sin_outer;
+    int is_spot;
+} light_reach_t;
+typedef struct {
+    int v1, v2;         // Vertex indices, v1 < v2
+    int face0, face1;   // Faces sharing the edge (face1 = -1 for an open edge)
+} mesh_edge_t;
 typedef struct {
     vec3_t* vertices;   // Dynamic array of vertices
     int* faces;         // Dynamic array of face indices (3 per triangle)
     vec3_t* normals;    // Dynamic array of per-vertex normal vectors
     int vertex_count;
     int face_count;
+    mesh_edge_t* edges; // Unique edges for the editor wireframe; NULL until built, dropped when faces change
+    int edge_count;
+    vec3_t bounds_min, bounds_max; // Local box of the vertices, cached by mesh_update_bounds()
+    vec3_t bounds_center;          // ...and a sphere around the box center holding every vertex
+    float bounds_radius;
+    int bounds_valid;              // 0 until computed; cleared by mesh_invalidate_bounds() when vertices change
+    float* vertex_streams;         // SoA copy of vertices and normals for SIMD, see mesh_vertex_streams(); NULL until built
 } mesh_t;
+#define MAX_LOD_LEVELS 4
 typedef struct {
     mesh_t* mesh;       // Pointer to the shared mesh data
     vec3_t position;    // Object's position in the world
@@ -48,13 +69,22 @@ typedef struct {
 
     // --- UI & PROPERTIES ---
     char name[64];      // Name for the object, to be displayed in the UI
-    RECT ui_outliner_rect; // The clickable screen-space rect for this object in the outliner
+    rect_t ui_outliner_rect; // The clickable screen-space rect for this object in the outliner
     int is_double_sided; // 0 = Backface Culling (Default), 1 = Render both sides
     int is_static;      // 0 = Dynamic (Default), 1 = Cannot be transformed in Scene Mode
     int is_player_spawn; // 0 = No (Default), 1 = Yes
     int has_collision;   // 0 = No (pass-through), 1 = Yes (solid)
     int is_player_model; // 0 = No (Default), 1 = Yes
     vec3_t camera_offset; // Point of interest for the camera, relative to the object's origin
+
+    // --- LEVEL OF DETAIL ---
+    mesh_t* lods[MAX_LOD_LEVELS]; // Coarser versions of mesh, finest first; owned by the object
+    int lod_count;
+    int lod_level;      // Level drawn last frame (0 = mesh), where the next selection starts
+    int lods_authored;  // The chain was generated, built or cleared already (even if empty); saving leaves it as it is
+
+    // --- BAKED LIGHTING ---
+    vec3_t* baked_lighting[MAX_LOD_LEVELS + 1]; // Per level (0 = mesh, n = lods[n - 1]), see bake.h; NULL = lit every frame
 } scene_object_t;
 
 typedef struct {
@@ -63,6 +93,17 @@ typedef struct {
     int capacity;
 } scene_t;
 
+typedef struct {
+    vec4_t planes[6];   // Inward normal in xyz, offset in w: a point p is inside when dot(xyz, p) + w >= 0
+} frustum_t;
+
+typedef struct {
+    int* indices;       // Object indices, nearest first; kept between frames as the next sort's starting point
+    float* distances;   // Scratch: distance to each object's bounds, by object index
+    int count;
+    int capacity;
+} draw_order_t;
+
 // --- Vector Functions ---
 vec3_t vec3_sub(vec3_t a, vec3_t b);
 vec3_t vec3_cross(vec3_t a, vec3_t b);
@@ -86,5 +127,34 @@ mat4_t mat4_inverse(mat4_t m);
 mat4_t mat4_scale(float sx, float sy, float sz);
 mat4_t mat4_get_world_transform(const scene_t* scene, int object_index);
 mat4_t mat4_orthographic(float left, float right, float bottom, float top, float near_plane, float far_plane);
+// --- Bounds and Culling ---
+void mesh_update_bounds(mesh_t* mesh);     // Recomputes the cached box and sphere if stale; an empty mesh gets a point at the origin
+void mesh_invalidate_bounds(mesh_t* mesh); // Call after moving, adding or removing vertices
+// World-space sphere of a mesh: the local sphere scaled by the largest axis of the transform
+void mesh_world_sphere(mesh_t* mesh, mat4_t world, vec3_t* center, float* radius);
+// World-space planes of the view volume: the four sides from the view-projection matrix, the
+// near plane through the eye (the rasterizer clips just in front of it, not at the projection's
+// near) and the far plane at far_distance down the view's -z, where the rasterizer rejects.
+frustum_t frustum_from_camera(mat4_t view, mat4_t projection, float far_distance);
+// 0 if the mesh's bounds under the world transform lie entirely outside the frustum. The
+// sphere is tried first, then the world-space box around the transformed local box.
+int frustum_test_mesh(const frustum_t* frustum, mesh_t* mesh, mat4_t world);
+// Distance at which the light's intensity / distance^2 falls to LIGHT_CUTOFF; 0 for unlit
+float light_influence_radius(const light_t* light);
+// Where a light can reach from its world position and spot direction. The renderer and the
+// bake both cull with light_reaches_sphere(), so they leave out the same lights.
+light_reach_t light_reach(const light_t* light, vec3_t position, vec3_t direction);
+int light_reaches_sphere(const light_reach_t* reach, vec3_t center, float radius);
+// --- Vertex Streams ---
+// The vertices and normals as six arrays (x, y, z, normal x, normal y, normal z), each
+// mesh_stream_stride() floats long with the tail past vertex_count zeroed, so SIMD code can
+// load four vertices at a time. Built on first use; NULL without normals or memory.
+const float* mesh_vertex_streams(mesh_t* mesh);
+void mesh_invalidate_vertex_streams(mesh_t* mesh); // Called when vertices or normals change
+int mesh_stream_stride(const mesh_t* mesh);        // vertex_count rounded up to a multiple of 4
+// --- Scene Ordering ---
+float scene_object_bounds_distance(const scene_t* scene, int object_index, vec3_t eye);
+void draw_order_update(draw_order_t* order, const scene_t* scene, vec3_t eye);
+void draw_order_free(draw_order_t* order);
 
 #endif // MATH3D_H
@@ -0,0 +1,202 @@
+// occlusion.c
+// Occluder depth buffer: a scalar edge-function rasterizer at low resolution, and the
+// conservative box test run against it.
+
+#include "occlusion.h"
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+
+static float* g_occlusion_depth = NULL; // Clip w per texel, FLT_MAX where no occluder was drawn
+static int g_occlusion_width = 0;       // 0 when the buffer could not be allocated: nothing is culled
+static int g_occlusion_height = 0;
+static int g_occlusion_capacity = 0;
+static int g_occlusion_empty = 1;       // Nothing written this frame, so every box is visible
+static vec4_t* g_occlusion_clip = NULL; // Scratch: clip-space vertices of the mesh being added
+static int g_occlusion_clip_capacity = 0;
+
+// --- Function Declarations ---
+static void occlusion_clip_triangle(vec4_t a, vec4_t b, vec4_t c, int double_sided);
+static void occlusion_draw_triangle(vec4_t a, vec4_t b, vec4_t c, int double_sided);
+
+void occlusion_begin_frame(int width, int height) {
+    int buffer_width = (width + OCCLUSION_SCALE - 1) / OCCLUSION_SCALE;
+    int buffer_height = (height + OCCLUSION_SCALE - 1) / OCCLUSION_SCALE;
+    int texel_count = buffer_width * buffer_height;
+    if (texel_count > g_occlusion_capacity) {
+        float* new_depth = (float*)realloc(g_occlusion_depth, texel_count * sizeof(float));
+        if (!new_depth) {
+            g_occlusion_width = g_occlusion_height = 0;
+            return;
+        }
+        g_occlusion_depth = new_depth;
+        g_occlusion_capacity = texel_count;
+    }
+    g_occlusion_width = buffer_width;
+    g_occlusion_height = buffer_height;
+    for (int i = 0; i < texel_count; i++) g_occlusion_depth[i] = FLT_MAX;
+    g_occlusion_empty = 1;
+}
+
+void occlusion_add_mesh(const mesh_t* mesh, mat4_t transform, int double_sided) {
+    if (g_occlusion_width == 0 || !mesh || mesh->vertex_count == 0) return;
+    if (mesh->vertex_count > g_occlusion_clip_capacity) {
+        vec4_t* new_clip = (vec4_t*)realloc(g_occlusion_clip, mesh->vertex_count * sizeof(vec4_t));
+        if (!new_clip) return;
+        g_occlusion_clip = new_clip;
+        g_occlusion_clip_capacity = mesh->vertex_count;
+    }
+    for (int i = 0; i < mesh->vertex_count; i++) {
+        g_occlusion_clip[i] = mat4_mul_vec4(transform, (vec4_t){mesh->vertices[i].x, mesh->vertices[i].y, mesh->vertices[i].z, 1.0f});
+    }
+    for (int i = 0; i < mesh->face_count; i++) {
+        occlusion_clip_triangle(g_occlusion_clip[mesh->faces[i * 3 + 0]], g_occlusion_clip[mesh->faces[i * 3 + 1]],
+                                g_occlusion_clip[mesh->faces[i * 3 + 2]], double_sided);
+    }
+}
+
+int occlusion_test_box(vec3_t box_min, vec3_t box_max, mat4_t transform) {
+    if (g_occlusion_width == 0) return 1;
+
+    float min_x = FLT_MAX, max_x = -FLT_MAX, min_y = FLT_MAX, max_y = -FLT_MAX, min_w = FLT_MAX;
+    for (int k = 0; k < 8; k++) {
+        vec4_t corner = mat4_mul_vec4(transform, (vec4_t){
+            (k & 1) ? box_max.x : box_min.x,
+            (k & 2) ? box_max.y : box_min.y,
+            (k & 4) ? box_max.z : box_min.z,
+            1.0f
+        });
+        if (corner.w < OCCLUSION_NEAR_W) return 1; // Reaches the near plane: the projected rectangle is not a bound
+        float inv_w = 1.0f / corner.w;
+        float x = (corner.x * inv_w + 1.0f) * 0.5f * g_occlusion_width;
+        float y = (1.0f - corner.y * inv_w) * 0.5f * g_occlusion_height;
+        min_x = (x < min_x) ? x : min_x;
+        max_x = (x > max_x) ? x : max_x;
+        min_y = (y < min_y) ? y : min_y;
+        max_y = (y > max_y) ? y : max_y;
+        min_w = (corner.w < min_w) ? corner.w : min_w;
+    }
+    if (max_x <= 0 || min_x >= g_occlusion_width || max_y <= 0 || min_y >= g_occlusion_height) return 0; // Off screen
+    if (g_occlusion_empty) return 1;
+
+    // Every texel the box touches plus a one-texel border; clamped as floats first, since
+    // corners close to the eye can project far outside the buffer
+    min_x = (min_x < 0) ? 0 : min_x;
+    min_y = (min_y < 0) ? 0 : min_y;
+    max_x = (max_x > g_occlusion_width) ? g_occlusion_width : max_x;
+    max_y = (max_y > g_occlusion_height) ? g_occlusion_height : max_y;
+    int x0 = (int)min_x - 1, y0 = (int)min_y - 1;
+    int x1 = (int)max_x + 1, y1 = (int)max_y + 1;
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 > g_occlusion_width - 1) ? g_occlusion_width - 1 : x1;
+    y1 = (y1 > g_occlusion_height - 1) ? g_occlusion_height - 1 : y1;
+
+    // Hidden only if every occluder texel is nearer than the box's nearest corner. The small
+    // margin keeps an occluder's own box from being hidden by its rounded depth.
+    float visible_depth = min_w * 0.9999f;
+    for (int y = y0; y <= y1; y++) {
+        const float* row = g_occlusion_depth + y * g_occlusion_width;
+        for (int x = x0; x <= x1; x++) {
+            if (row[x] >= visible_depth) return 1;
+        }
+    }
+    return 0;
+}
+
+void occlusion_shutdown(void) {
+    free(g_occlusion_depth);
+    free(g_occlusion_clip);
+    g_occlusion_depth = NULL;
+    g_occlusion_clip = NULL;
+    g_occlusion_width = g_occlusion_height = 0;
+    g_occlusion_capacity = 0;
+    g_occlusion_clip_capacity = 0;
+}
+
+// --- Occluder Rasterizer ---
+// Clips against w = OCCLUSION_NEAR_W, turning a triangle into at most a quad
+static void occlusion_clip_triangle(vec4_t a, vec4_t b, vec4_t c, int double_sided) {
+    if (a.w >= OCCLUSION_NEAR_W && b.w >= OCCLUSION_NEAR_W && c.w >= OCCLUSION_NEAR_W) {
+        occlusion_draw_triangle(a, b, c, double_sided);
+        return;
+    }
+    vec4_t in[3] = {a, b, c};
+    vec4_t out[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        vec4_t p = in[i];
+        vec4_t q = in[(i + 1) % 3];
+        int p_inside = p.w >= OCCLUSION_NEAR_W;
+        int q_inside = q.w >= OCCLUSION_NEAR_W;
+        if (p_inside) out[count++] = p;
+        if (p_inside != q_inside) {
+            float t = (OCCLUSION_NEAR_W - p.w) / (q.w - p.w);
+            out[count++] = (vec4_t){p.x + (q.x - p.x) * t, p.y + (q.y - p.y) * t, p.z + (q.z - p.z) * t, OCCLUSION_NEAR_W};
+        }
+    }
+    for (int i = 1; i + 1 < count; i++) {
+        occlusion_draw_triangle(out[0], out[i], out[i + 1], double_sided);
+    }
+}
+
+// Samples coverage at texel centers. Depth is 1/w interpolated linearly in screen space and
+// taken at the texel's farthest corner (never past the farthest vertex), so a texel never
+// claims the occluder is nearer than it is anywhere the triangle covers.
+static void occlusion_draw_triangle(vec4_t a, vec4_t b, vec4_t c, int double_sided) {
+    vec4_t v[3] = {a, b, c};
+    float sx[3], sy[3], q[3];
+    for (int k = 0; k < 3; k++) {
+        q[k] = 1.0f / v[k].w;
+        sx[k] = (v[k].x * q[k] + 1.0f) * 0.5f * g_occlusion_width;
+        sy[k] = (1.0f - v[k].y * q[k]) * 0.5f * g_occlusion_height;
+    }
+
+    // Screen y points down, so the renderer's back faces (negative NDC area) come out positive here
+    float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+    if (area == 0.0f) return;
+    if (area > 0.0f) {
+        if (!double_sided) return;
+    } else {
+        // Front face: swap two vertices so the edge functions below are positive inside
+        float t;
+        t = sx[1]; sx[1] = sx[2]; sx[2] = t;
+        t = sy[1]; sy[1] = sy[2]; sy[2] = t;
+        t = q[1]; q[1] = q[2]; q[2] = t;
+        area = -area;
+    }
+
+    float min_sx = fminf(sx[0], fminf(sx[1], sx[2])), max_sx = fmaxf(sx[0], fmaxf(sx[1], sx[2]));
+    float min_sy = fminf(sy[0], fminf(sy[1], sy[2])), max_sy = fmaxf(sy[0], fmaxf(sy[1], sy[2]));
+    if (max_sx < 0.5f || min_sx > g_occlusion_width - 0.5f || max_sy < 0.5f || min_sy > g_occlusion_height - 0.5f) return;
+    int x0 = (min_sx < 0.5f) ? 0 : (int)ceilf(min_sx - 0.5f);
+    int y0 = (min_sy < 0.5f) ? 0 : (int)ceilf(min_sy - 0.5f);
+    int x1 = (max_sx > g_occlusion_width - 0.5f) ? g_occlusion_width - 1 : (int)floorf(max_sx - 0.5f);
+    int y1 = (max_sy > g_occlusion_height - 0.5f) ? g_occlusion_height - 1 : (int)floorf(max_sy - 0.5f);
+
+    float inv_area = 1.0f / area;
+    float dq_dx = ((q[1] - q[0]) * (sy[2] - sy[0]) - (q[2] - q[0]) * (sy[1] - sy[0])) * inv_area;
+    float dq_dy = ((q[2] - q[0]) * (sx[1] - sx[0]) - (q[1] - q[0]) * (sx[2] - sx[0])) * inv_area;
+    float corner_offset = 0.5f * (fabsf(dq_dx) + fabsf(dq_dy));
+    float q_floor = fminf(q[0], fminf(q[1], q[2]));
+
+    for (int y = y0; y <= y1; y++) {
+        float py = (float)y + 0.5f;
+        float* row = g_occlusion_depth + y * g_occlusion_width;
+        for (int x = x0; x <= x1; x++) {
+            float px = (float)x + 0.5f;
+            float e0 = (sx[1] - sx[0]) * (py - sy[0]) - (sy[1] - sy[0]) * (px - sx[0]);
+            float e1 = (sx[2] - sx[1]) * (py - sy[1]) - (sy[2] - sy[1]) * (px - sx[1]);
+            float e2 = (sx[0] - sx[2]) * (py - sy[2]) - (sy[0] - sy[2]) * (px - sx[2]);
+            if (e0 < 0 || e1 < 0 || e2 < 0) continue;
+
+            float q_texel = q[0] + dq_dx * (px - sx[0]) + dq_dy * (py - sy[0]) - corner_offset;
+            q_texel = (q_texel < q_floor) ? q_floor : q_texel;
+            float depth = 1.0f / q_texel;
+            if (depth < row[x]) {
+                row[x] = depth;
+                g_occlusion_empty = 0;
+            }
+        }
+    }
+}
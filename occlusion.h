@@ -0,0 +1,23 @@
+// occlusion.h
+// Software occlusion culling: a small depth buffer rasterized from a few large occluders,
+// against which object bounding boxes are tested before any of their vertices are touched.
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+#include "math3d.h"
+
+#define OCCLUSION_SCALE 4       // The occluder buffer is 1/4 of the render size on each axis
+#define OCCLUSION_NEAR_W 0.001f // Occluders are clipped, and boxes reaching it are never hidden, at this clip w
+
+// Clears the occluder buffer for a render target of width x height pixels
+void occlusion_begin_frame(int width, int height);
+// Rasterizes a mesh's front faces (all faces if double_sided); transform maps model to clip
+// space. Stored depth is clip w, kept no nearer than the mesh anywhere inside a texel.
+void occlusion_add_mesh(const mesh_t* mesh, mat4_t transform, int double_sided);
+// Returns 0 if the box is off screen or behind the occluders added so far, 1 if any of it may
+// be visible. A texel border around the box is included to cover occluder edges that only
+// partly overlap a texel.
+int occlusion_test_box(vec3_t box_min, vec3_t box_max, mat4_t transform);
+void occlusion_shutdown(void); // Frees the buffers
+
+#endif // OCCLUSION_H
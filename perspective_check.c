@@ -0,0 +1,208 @@
+//gcc -O2 perspective_check.c raster.c math3d.c platform_headless.c -o perspective_check -lpthread -lm
+// perspective_check.c
+// Checks the error bound raster.c states for span subdivision. Random Gouraud triangles
+// with steep depth are drawn one per frame, once with an exact divide per pixel and once
+// for each subdivision step, and every pixel of the subdivided image must be within
+//   |A_end - A_start| * (sqrt(q) - 1) / (sqrt(q) + 1)
+// of the exact one, for depth and each color channel, where A_start and A_end are the exact
+// values at the ends of the pixel's segment and q is the ratio of their depths. Subdivided
+// depth must also never be closer than exact depth. Exits with 1 at the first violation.
+//
+//   perspective_check [-triangles=n] [-size=WxH] [-seed=n]
+//     -triangles=<n>   Triangles per step (2000)
+//     -size=<w>x<h>    Frame size (320x240)
+//     -seed=<n>        Seed of the triangle generator (1)
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+#include "math3d.h"
+#include "raster.h"
+
+typedef struct {
+    vec4_t position[3];
+    vec3_t color[3];
+} check_triangle_t;
+
+typedef struct {
+    uint32_t* color;
+    float* depth;
+} check_frame_t;
+
+typedef struct {
+    long pixels;        // Pixels compared
+    double worst_depth; // Largest depth error seen where the bound is well above rounding, as a fraction of the bound
+    int worst_color;    // Largest color error seen, in levels
+} check_result_t;
+
+// --- Function Declarations ---
+const char* find_option(int argc, char** argv, const char* name);
+float next_random(uint32_t* state, float min_value, float max_value);
+check_triangle_t random_triangle(uint32_t* state);
+void draw_triangle(const check_triangle_t* tri, const check_frame_t* frame, int width, int height, int perspective_step);
+int check_frame(const check_frame_t* exact, const check_frame_t* subdivided, int width, int height, int perspective_step, check_result_t* result);
+
+// --- Options ---
+// Value of "-name=value" (name passed with its '=')
+const char* find_option(int argc, char** argv, const char* name) {
+    size_t length = strlen(name);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], name, length) == 0) return argv[i] + length;
+    }
+    return NULL;
+}
+
+// --- Triangles ---
+// Same sequence on every platform, unlike rand()
+float next_random(uint32_t* state, float min_value, float max_value) {
+    *state = *state * 1664525u + 1013904223u;
+    return min_value + (max_value - min_value) * (float)(*state >> 8) / 16777216.0f;
+}
+
+// Vertices anywhere on screen at w from 0.5 to 40, so one triangle can span a depth ratio of
+// 80 and a segment a large part of that; colors stay in 0..1 so nothing saturates
+check_triangle_t random_triangle(uint32_t* state) {
+    check_triangle_t tri;
+    for (int i = 0; i < 3; i++) {
+        float w = next_random(state, 0.5f, 40.0f);
+        float x = next_random(state, -1.0f, 1.0f), y = next_random(state, -1.0f, 1.0f);
+        tri.position[i] = (vec4_t){x * w, y * w, 0.5f * w, w};
+        tri.color[i] = (vec3_t){next_random(state, 0.0f, 1.0f), next_random(state, 0.0f, 1.0f), next_random(state, 0.0f, 1.0f)};
+    }
+    return tri;
+}
+
+void draw_triangle(const check_triangle_t* tri, const check_frame_t* frame, int width, int height, int perspective_step) {
+    raster_set_perspective_step(perspective_step);
+    raster_clear(frame->color, 0, frame->depth, width, height);
+    raster_begin_frame(frame->color, frame->depth, width, height);
+    raster_submit_gouraud(tri->position[0], tri->position[1], tri->position[2], tri->color[0], tri->color[1], tri->color[2]);
+    raster_end_frame();
+}
+
+// --- Checking ---
+// Rebuilds the span walker's segments from the exact image: each tile row's span starts at
+// its first covered pixel and every segment ends on the next one's first pixel, or on the
+// last covered pixel at the end of the span. Returns 0 and reports the first violation.
+int check_frame(const check_frame_t* exact, const check_frame_t* subdivided, int width, int height, int perspective_step, check_result_t* result) {
+    for (int y = 0; y < height; y++) {
+        const float* exact_depth = exact->depth + (size_t)y * width;
+        const float* test_depth = subdivided->depth + (size_t)y * width;
+        const uint32_t* exact_color = exact->color + (size_t)y * width;
+        const uint32_t* test_color = subdivided->color + (size_t)y * width;
+
+        for (int tile_x0 = 0; tile_x0 < width; tile_x0 += RASTER_TILE_SIZE) {
+            int tile_x1 = (tile_x0 + RASTER_TILE_SIZE < width) ? tile_x0 + RASTER_TILE_SIZE : width;
+            int x_start = tile_x1, x_end = tile_x0;
+            for (int x = tile_x0; x < tile_x1; x++) {
+                if ((exact_depth[x] < FLT_MAX) != (test_depth[x] < FLT_MAX)) {
+                    fprintf(stderr, "step %d: pixel (%d, %d) covered in only one image\n", perspective_step, x, y);
+                    return 0;
+                }
+                if (exact_depth[x] < FLT_MAX) {
+                    x_start = (x < x_start) ? x : x_start;
+                    x_end = x + 1;
+                }
+            }
+
+            for (int x = x_start; x < x_end;) {
+                int n = (x_end - x < perspective_step) ? x_end - x : perspective_step;
+                int anchor = (x + n < x_end) ? n : n - 1;
+                float w_a = exact_depth[x], w_b = exact_depth[x + anchor];
+                double q = (w_a > w_b) ? (double)w_a / w_b : (double)w_b / w_a;
+                double factor = (sqrt(q) - 1.0) / (sqrt(q) + 1.0);
+                double depth_bound = fabs((double)w_b - w_a) * factor;
+                // The exact colors are truncated to whole levels, so their difference can be
+                // a level short, and the compared pixels each lose up to a level more
+                double color_bound[3];
+                for (int c = 0; c < 3; c++) {
+                    int level_a = (exact_color[x] >> (16 - 8 * c)) & 0xFF, level_b = (exact_color[x + anchor] >> (16 - 8 * c)) & 0xFF;
+                    color_bound[c] = (abs(level_b - level_a) + 1) * factor + 1.0;
+                }
+
+                for (int i = x; i < x + n; i++) {
+                    double slack = exact_depth[i] * 1e-4; // Stepping from the span start rounds differently from the plane
+                    double depth_error = (double)test_depth[i] - exact_depth[i];
+                    if (depth_error < -slack || depth_error > depth_bound + slack) {
+                        fprintf(stderr, "step %d: pixel (%d, %d) depth %.7g, exact %.7g, bound %.7g\n",
+                                perspective_step, i, y, test_depth[i], exact_depth[i], depth_bound);
+                        return 0;
+                    }
+                    if (depth_bound > 100.0 * slack && depth_error / depth_bound > result->worst_depth) result->worst_depth = depth_error / depth_bound;
+
+                    for (int c = 0; c < 3; c++) {
+                        int shift = 16 - 8 * c;
+                        int color_error = abs((int)((test_color[i] >> shift) & 0xFF) - (int)((exact_color[i] >> shift) & 0xFF));
+                        if (color_error > color_bound[c] + 0.01) {
+                            fprintf(stderr, "step %d: pixel (%d, %d) channel %d is %d levels off, bound %.3f\n",
+                                    perspective_step, i, y, c, color_error, color_bound[c]);
+                            return 0;
+                        }
+                        result->worst_color = (color_error > result->worst_color) ? color_error : result->worst_color;
+                    }
+                    result->pixels++;
+                }
+                x += n;
+            }
+        }
+    }
+    return 1;
+}
+
+// --- Main Entry Point ---
+int main(int argc, char** argv) {
+    int width = 320, height = 240;
+    const char* option = find_option(argc, argv, "-size=");
+    if (option && (sscanf(option, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+        fprintf(stderr, "bad -size=%s\n", option);
+        return 2;
+    }
+    option = find_option(argc, argv, "-triangles=");
+    int triangle_count = option ? atoi(option) : 2000;
+    option = find_option(argc, argv, "-seed=");
+    uint32_t seed = option ? (uint32_t)strtoul(option, NULL, 10) : 1u;
+
+    size_t pixel_count = (size_t)width * height;
+    check_frame_t exact, subdivided;
+    exact.color = (uint32_t*)malloc(pixel_count * sizeof(uint32_t));
+    exact.depth = (float*)malloc(pixel_count * sizeof(float));
+    subdivided.color = (uint32_t*)malloc(pixel_count * sizeof(uint32_t));
+    subdivided.depth = (float*)malloc(pixel_count * sizeof(float));
+    if (!exact.color || !exact.depth || !subdivided.color || !subdivided.depth) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    raster_init(1);
+    raster_set_mode(RASTER_MODE_SCANLINE);
+
+    static const int steps[] = {8, 16, RASTER_MAX_PERSPECTIVE_STEP};
+    int failed = 0;
+    for (int s = 0; s < (int)(sizeof(steps) / sizeof(steps[0])) && !failed; s++) {
+        check_result_t result = {0};
+        uint32_t state = seed;
+        for (int t = 0; t < triangle_count && !failed; t++) {
+            check_triangle_t tri = random_triangle(&state);
+            draw_triangle(&tri, &exact, width, height, 1);
+            draw_triangle(&tri, &subdivided, width, height, steps[s]);
+            if (!check_frame(&exact, &subdivided, width, height, steps[s], &result)) {
+                fprintf(stderr, "triangle %d of seed %u\n", t, seed);
+                failed = 1;
+            }
+        }
+        if (!failed) {
+            printf("step %d: %ld pixels within bounds, worst depth error %.3f%% of its bound, worst color error %d levels\n",
+                   steps[s], result.pixels, result.worst_depth * 100.0, result.worst_color);
+        }
+    }
+
+    raster_shutdown();
+    free(exact.color);
+    free(exact.depth);
+    free(subdivided.color);
+    free(subdivided.depth);
+    return failed;
+}
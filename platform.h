@@ -0,0 +1,34 @@
+// platform.h
+// The little the portable core (math3d, raster, scene, collision, render) needs from
+// the operating system: worker threads, a counting semaphore, interlocked counters,
+// the core count and a clock. Windows, HDCs and input stay in the frontends.
+//
+// Backends, link exactly one:
+//   platform_win32.c    -- editor and player
+//   platform_headless.c -- POSIX threads, no window; for running the core on Linux
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+typedef struct platform_thread_s* platform_thread_t;
+typedef struct platform_semaphore_s* platform_semaphore_t;
+typedef int (*platform_thread_proc_t)(void* param);
+
+// --- Threads ---
+platform_thread_t platform_thread_create(platform_thread_proc_t proc, void* param); // NULL on failure
+void platform_thread_join(platform_thread_t thread); // Waits for the thread to return and frees the handle
+
+// --- Synchronization ---
+platform_semaphore_t platform_semaphore_create(int initial_count, int max_count); // NULL on failure
+void platform_semaphore_post(platform_semaphore_t semaphore, int count);
+void platform_semaphore_wait(platform_semaphore_t semaphore);
+void platform_semaphore_destroy(platform_semaphore_t semaphore);
+long platform_atomic_increment(volatile long* value); // Both return the new value
+long platform_atomic_decrement(volatile long* value);
+void platform_atomic_add(volatile long* value, long amount);
+
+// --- System ---
+int platform_cpu_count(void);       // Logical cores, at least 1
+double platform_time_seconds(void); // Monotonic clock with an arbitrary origin
+
+#endif // PLATFORM_H
@@ -0,0 +1,108 @@
+// platform_headless.c
+// platform.h on POSIX threads, with no window system at all. Lets the core build and
+// run on Linux (build farm, perf/valgrind), rendering into plain memory:
+//   gcc -O2 -c math3d.c raster.c scene.c collision.c render.c occlusion.c lod.c bake.c specular.c platform_headless.c
+//   ...link with -lpthread -lm
+
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "platform.h"
+
+// --- Threads ---
+struct platform_thread_s {
+    pthread_t handle;
+    platform_thread_proc_t proc;
+    void* param;
+};
+
+static void* platform_thread_main(void* param) {
+    struct platform_thread_s* thread = (struct platform_thread_s*)param;
+    thread->proc(thread->param);
+    return NULL;
+}
+
+platform_thread_t platform_thread_create(platform_thread_proc_t proc, void* param) {
+    struct platform_thread_s* thread = (struct platform_thread_s*)malloc(sizeof(struct platform_thread_s));
+    if (!thread) return NULL;
+    thread->proc = proc;
+    thread->param = param;
+    if (pthread_create(&thread->handle, NULL, platform_thread_main, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void platform_thread_join(platform_thread_t thread) {
+    if (!thread) return;
+    pthread_join(thread->handle, NULL);
+    free(thread);
+}
+
+// --- Synchronization ---
+// Mutex and condition variable rather than sem_t, which not every POSIX system has unnamed
+struct platform_semaphore_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+    int count;
+    int max_count;
+};
+
+platform_semaphore_t platform_semaphore_create(int initial_count, int max_count) {
+    struct platform_semaphore_s* semaphore = (struct platform_semaphore_s*)malloc(sizeof(struct platform_semaphore_s));
+    if (!semaphore) return NULL;
+    pthread_mutex_init(&semaphore->mutex, NULL);
+    pthread_cond_init(&semaphore->available, NULL);
+    semaphore->count = initial_count;
+    semaphore->max_count = max_count;
+    return semaphore;
+}
+
+void platform_semaphore_post(platform_semaphore_t semaphore, int count) {
+    if (count <= 0) return;
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->count = (semaphore->count + count > semaphore->max_count) ? semaphore->max_count : semaphore->count + count;
+    pthread_cond_broadcast(&semaphore->available);
+    pthread_mutex_unlock(&semaphore->mutex);
+}
+
+void platform_semaphore_wait(platform_semaphore_t semaphore) {
+    pthread_mutex_lock(&semaphore->mutex);
+    while (semaphore->count == 0) pthread_cond_wait(&semaphore->available, &semaphore->mutex);
+    semaphore->count--;
+    pthread_mutex_unlock(&semaphore->mutex);
+}
+
+void platform_semaphore_destroy(platform_semaphore_t semaphore) {
+    if (!semaphore) return;
+    pthread_cond_destroy(&semaphore->available);
+    pthread_mutex_destroy(&semaphore->mutex);
+    free(semaphore);
+}
+
+long platform_atomic_increment(volatile long* value) {
+    return __sync_add_and_fetch(value, 1);
+}
+
+long platform_atomic_decrement(volatile long* value) {
+    return __sync_sub_and_fetch(value, 1);
+}
+
+void platform_atomic_add(volatile long* value, long amount) {
+    __sync_fetch_and_add(value, amount);
+}
+
+// --- System ---
+int platform_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+}
+
+double platform_time_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
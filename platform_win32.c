@@ -0,0 +1,83 @@
+// platform_win32.c
+// platform.h on top of the Win32 API.
+
+#include <windows.h>
+#include <stdlib.h>
+#include "platform.h"
+
+// --- Threads ---
+struct platform_thread_s {
+    HANDLE handle;
+    platform_thread_proc_t proc;
+    void* param;
+};
+
+static DWORD WINAPI platform_thread_main(LPVOID param) {
+    struct platform_thread_s* thread = (struct platform_thread_s*)param;
+    return (DWORD)thread->proc(thread->param);
+}
+
+platform_thread_t platform_thread_create(platform_thread_proc_t proc, void* param) {
+    struct platform_thread_s* thread = (struct platform_thread_s*)malloc(sizeof(struct platform_thread_s));
+    if (!thread) return NULL;
+    thread->proc = proc;
+    thread->param = param;
+    thread->handle = CreateThread(NULL, 0, platform_thread_main, thread, 0, NULL);
+    if (!thread->handle) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void platform_thread_join(platform_thread_t thread) {
+    if (!thread) return;
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+// --- Synchronization ---
+// The semaphore handle is the opaque pointer itself
+platform_semaphore_t platform_semaphore_create(int initial_count, int max_count) {
+    return (platform_semaphore_t)CreateSemaphore(NULL, initial_count, max_count, NULL);
+}
+
+void platform_semaphore_post(platform_semaphore_t semaphore, int count) {
+    if (count > 0) ReleaseSemaphore((HANDLE)semaphore, count, NULL);
+}
+
+void platform_semaphore_wait(platform_semaphore_t semaphore) {
+    WaitForSingleObject((HANDLE)semaphore, INFINITE);
+}
+
+void platform_semaphore_destroy(platform_semaphore_t semaphore) {
+    if (semaphore) CloseHandle((HANDLE)semaphore);
+}
+
+long platform_atomic_increment(volatile long* value) {
+    return InterlockedIncrement(value);
+}
+
+long platform_atomic_decrement(volatile long* value) {
+    return InterlockedDecrement(value);
+}
+
+void platform_atomic_add(volatile long* value, long amount) {
+    InterlockedExchangeAdd(value, amount);
+}
+
+// --- System ---
+int platform_cpu_count(void) {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (system_info.dwNumberOfProcessors > 0) ? (int)system_info.dwNumberOfProcessors : 1;
+}
+
+double platform_time_seconds(void) {
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
@@ -0,0 +1,1627 @@
+// raster.c
+// Tile-binned triangle rasterizer shared by the editor and the player.
+// Triangles are set up and sorted into 64x64 screen bins as they are submitted,
+// then every bin is rasterized by a small worker pool when the frame is flushed.
+// Each bin owns a disjoint rectangle of the color/depth buffers, so the workers
+// never need to lock anything.
+// A coarse depth buffer keeps the farthest depth of every 8x8 block, so triangles
+// and blocks that lie behind everything already drawn are skipped before shading.
+// Submitted triangles are in clip space: ones outside the frustum are rejected,
+// ones inside the guard band go straight to setup, and only the rest are clipped.
+// Setup drops triangles that cover no pixel center and sends ones that fit in a few
+// pixels to a per-pixel path instead of the walkers.
+// Every walker takes coverage from the same edge functions and evaluates attributes
+// with the same plane equations, so all modes draw the same pixels in the same colors.
+
+#include "raster.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+typedef struct {
+    vec3_t screen[3];   // Screen x, screen y, NDC z -- sorted by y
+    float w_inv[3];     // 1/w for perspective-correct interpolation
+    vec3_t c_pw[3];     // Vertex colors divided by w
+    int y_start, y_end; // Rows whose centers lie within the vertices' extent, clamped to the screen
+    int x_start, x_end; // ...and the same for columns
+    float min_depth;    // Nearest vertex w in depth buffer units; no pixel of the triangle is closer
+    int is_small;       // Few enough pixels for raster_draw_small_triangle()
+    int is_flat;
+    uint32_t flat_color;
+
+    // --- Edge Functions ---
+    // The center (x + 0.5, y + 0.5) is covered when every edge gives
+    //   dx * (y + 0.5 - ay) - dy * (x + 0.5 - ax)
+    // above zero, or exactly zero on an edge that owns ties (top-left rule). Each edge is
+    // set up from its end points in a fixed order and only the sign depends on the
+    // triangle, so two triangles sharing an edge get the same value negated and a center
+    // on it goes to exactly one of them. Every walker evaluates the same expression.
+    float edge_ax[3], edge_ay[3];
+    float edge_dx[3], edge_dy[3];
+    float edge_slope[3];    // dx / dy, only used to guess where a row crosses the edge
+    int edge_owns_ties[3];
+
+    // --- Attribute Planes ---
+    // 1/w, r/w, g/w, b/w at pixel (x, y) are p0 + dy * (y - oy) + dx * (x - ox), evaluated
+    // in that order by every walker so they all produce the same pixels
+    float attr_p0[4];
+    float attr_dx[4], attr_dy[4];
+    float attr_ox, attr_oy; // Top vertex less half a pixel, so (x, y) is sampled at its center
+} raster_triangle_t;
+
+typedef struct {
+    vec4_t position;    // Clip space
+    vec3_t color;
+} raster_vertex_t;
+
+typedef struct {
+    int* items;         // Indices into g_raster_triangles, in submission order
+    int count;
+    int capacity;
+    uint32_t depth_epoch; // Lazy depth clear: the tile's depth is valid when this matches g_raster_depth_epoch
+} raster_bin_t;
+
+// --- Frame State ---
+static raster_mode_t g_raster_mode = RASTER_MODE_SCANLINE;
+static int g_raster_perspective_step = 1; // Span walker divides every N pixels, 1 = every pixel
+static int g_raster_lazy_depth_clear = 0;   // raster_clear() leaves depth alone; tiles clear on first touch
+static uint32_t g_raster_depth_epoch = 0;   // Bumped by every lazy raster_clear()
+static raster_depth_format_t g_raster_depth_format = RASTER_DEPTH_FLOAT32;
+static uint32_t* g_raster_color = NULL;
+static float* g_raster_depth = NULL;
+static int g_raster_width = 0;
+static int g_raster_height = 0;
+static int g_raster_tiles_x = 0;
+static int g_raster_tiles_y = 0;
+static raster_bin_t* g_raster_bins = NULL;
+static int g_raster_bin_capacity = 0;
+static raster_triangle_t* g_raster_triangles = NULL;
+static int g_raster_triangle_count = 0;
+static int g_raster_triangle_capacity = 0;
+static vec4_t g_raster_far_plane = {0, 0, 0, 1}; // Clip-space plane; points with a negative distance are beyond far
+
+// --- Compact Depth ---
+// The 16/24-bit formats store (1/w_near - 1/w) / (1/w_near - 1/w_far) scaled to the
+// integer range, where w is the float depth the buffer would otherwise hold. That is
+// affine in 1/w, which the walkers already interpolate, so depth steps exactly across a
+// span and only pixels that pass the test pay for the perspective divide.
+static uint8_t* g_raster_depth_compact = NULL; // 2 or 3 bytes per pixel, row-major like the color buffer
+static size_t g_raster_depth_compact_capacity = 0;
+static float g_raster_depth_inv_near = 1.0f;   // 1/w at the near plane
+static float g_raster_depth_scale = 0.0f;      // Integer units per unit of 1/w
+
+// --- Coarse Depth ---
+// One entry per 8x8 block. Blocks never straddle a tile, so each worker only
+// touches the entries of its own tile.
+static float* g_raster_block_max_depth = NULL; // Farthest depth in the block (while not dirty)
+static uint8_t* g_raster_block_dirty = NULL;   // Block was drawn to since its max was computed
+static int g_raster_blocks_x = 0;
+static int g_raster_blocks_y = 0;
+static int g_raster_block_capacity = 0;
+
+// --- Worker Pool ---
+static platform_thread_t g_raster_threads[RASTER_MAX_THREADS];
+static int g_raster_worker_count = 0;
+static platform_semaphore_t g_raster_start_semaphore = NULL;
+static platform_semaphore_t g_raster_done_semaphore = NULL; // Posted once by the last worker to finish
+static volatile long g_raster_next_tile = 0;
+static volatile long g_raster_workers_busy = 0;
+static volatile long g_raster_quit = 0;
+
+// --- Statistics ---
+static volatile long g_raster_pixels_tested = 0;
+static volatile long g_raster_pixels_written = 0;
+
+// --- Buffer Clearing ---
+// A full frame clear uses streaming stores: the buffers are bigger than the cache and
+// are about to be overwritten, so there is no point reading them in first. The lazy
+// per-tile depth clear uses normal stores since the tile is drawn right after.
+static void raster_fill_color(uint32_t* dst, uint32_t value, size_t count, int streaming) {
+#ifdef RASTER_HAS_SSE2
+    while (count > 0 && ((uintptr_t)dst & 15)) { *dst++ = value; count--; }
+    __m128i v = _mm_set1_epi32((int)value);
+    if (streaming) {
+        for (; count >= 16; count -= 16, dst += 16) {
+            _mm_stream_si128((__m128i*)dst, v);
+            _mm_stream_si128((__m128i*)(dst + 4), v);
+            _mm_stream_si128((__m128i*)(dst + 8), v);
+            _mm_stream_si128((__m128i*)(dst + 12), v);
+        }
+        _mm_sfence();
+    }
+    for (; count >= 4; count -= 4, dst += 4) _mm_store_si128((__m128i*)dst, v);
+#else
+    (void)streaming;
+#endif
+    while (count > 0) { *dst++ = value; count--; }
+}
+
+static void raster_fill_depth(float* dst, float value, size_t count, int streaming) {
+#ifdef RASTER_HAS_SSE2
+    while (count > 0 && ((uintptr_t)dst & 15)) { *dst++ = value; count--; }
+    __m128 v = _mm_set1_ps(value);
+    if (streaming) {
+        for (; count >= 16; count -= 16, dst += 16) {
+            _mm_stream_ps(dst, v);
+            _mm_stream_ps(dst + 4, v);
+            _mm_stream_ps(dst + 8, v);
+            _mm_stream_ps(dst + 12, v);
+        }
+        _mm_sfence();
+    }
+    for (; count >= 4; count -= 4, dst += 4) _mm_store_ps(dst, v);
+#else
+    (void)streaming;
+#endif
+    while (count > 0) { *dst++ = value; count--; }
+}
+
+static inline uint32_t raster_compact_depth_max(void) {
+    return (g_raster_depth_format == RASTER_DEPTH_UNORM16) ? 0xFFFFu : 0xFFFFFFu;
+}
+
+static inline int raster_compact_depth_bytes(void) {
+    return (g_raster_depth_format == RASTER_DEPTH_UNORM16) ? 2 : 3;
+}
+
+static inline uint32_t raster_load_compact_depth(int index) {
+    if (g_raster_depth_format == RASTER_DEPTH_UNORM16) return ((const uint16_t*)g_raster_depth_compact)[index];
+    const uint8_t* p = g_raster_depth_compact + index * 3;
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static inline void raster_store_compact_depth(int index, uint32_t depth) {
+    if (g_raster_depth_format == RASTER_DEPTH_UNORM16) {
+        ((uint16_t*)g_raster_depth_compact)[index] = (uint16_t)depth;
+        return;
+    }
+    uint8_t* p = g_raster_depth_compact + index * 3;
+    p[0] = (uint8_t)depth; p[1] = (uint8_t)(depth >> 8); p[2] = (uint8_t)(depth >> 16);
+}
+
+// Quantizes a float depth (w, or whatever a direct writer stores in its place)
+static uint32_t raster_compact_depth_from_w(float w) {
+    if (w <= 0.0f) return 0;
+    float depth = (g_raster_depth_inv_near - 1.0f / w) * g_raster_depth_scale;
+    uint32_t depth_max = raster_compact_depth_max();
+    return (depth <= 0.0f) ? 0 : (depth >= (float)depth_max) ? depth_max : (uint32_t)depth;
+}
+
+// Grows the compact buffer to cover width x height; the contents are undefined after a move
+static int raster_reserve_compact_depth(int width, int height) {
+    size_t bytes = (size_t)width * height * raster_compact_depth_bytes();
+    bytes = (bytes + 3) & ~(size_t)3; // Whole words, so the clear can fill 32 bits at a time
+    if (bytes <= g_raster_depth_compact_capacity) return 1;
+    uint8_t* new_depth = (uint8_t*)realloc(g_raster_depth_compact, bytes);
+    if (!new_depth) return 0;
+    g_raster_depth_compact = new_depth;
+    g_raster_depth_compact_capacity = bytes;
+    for (int i = 0; i < g_raster_bin_capacity; i++) g_raster_bins[i].depth_epoch = 0;
+    return 1;
+}
+
+// Lazy depth clear: gives the tile its FLT_MAX depth the first time it is touched in a frame
+static void raster_prepare_depth_tile(int tile) {
+    raster_bin_t* bin = &g_raster_bins[tile];
+    if (bin->depth_epoch == g_raster_depth_epoch) return;
+    int tile_x0 = (tile % g_raster_tiles_x) * RASTER_TILE_SIZE;
+    int tile_y0 = (tile / g_raster_tiles_x) * RASTER_TILE_SIZE;
+    int tile_x1 = (tile_x0 + RASTER_TILE_SIZE < g_raster_width) ? tile_x0 + RASTER_TILE_SIZE : g_raster_width;
+    int tile_y1 = (tile_y0 + RASTER_TILE_SIZE < g_raster_height) ? tile_y0 + RASTER_TILE_SIZE : g_raster_height;
+    if (g_raster_depth_format != RASTER_DEPTH_FLOAT32) {
+        int bytes = raster_compact_depth_bytes();
+        for (int y = tile_y0; y < tile_y1; y++) {
+            memset(g_raster_depth_compact + (y * g_raster_width + tile_x0) * bytes, 0xFF, (tile_x1 - tile_x0) * bytes); // All ones is the far value
+        }
+    } else {
+        for (int y = tile_y0; y < tile_y1; y++) {
+            raster_fill_depth(g_raster_depth + y * g_raster_width + tile_x0, FLT_MAX, tile_x1 - tile_x0, 0);
+        }
+    }
+    bin->depth_epoch = g_raster_depth_epoch;
+}
+
+// --- Coarse Depth ---
+static float raster_block_max_depth(int block_x, int block_y) {
+    int block = block_y * g_raster_blocks_x + block_x;
+    if (g_raster_block_dirty[block]) {
+        int x0 = block_x * RASTER_BLOCK_SIZE, y0 = block_y * RASTER_BLOCK_SIZE;
+        int x1 = (x0 + RASTER_BLOCK_SIZE < g_raster_width) ? x0 + RASTER_BLOCK_SIZE : g_raster_width;
+        int y1 = (y0 + RASTER_BLOCK_SIZE < g_raster_height) ? y0 + RASTER_BLOCK_SIZE : g_raster_height;
+        float max_depth = 0.0f;
+        if (g_raster_depth_format != RASTER_DEPTH_FLOAT32) {
+            uint32_t max_compact = 0;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    uint32_t depth = raster_load_compact_depth(y * g_raster_width + x);
+                    max_compact = (depth > max_compact) ? depth : max_compact;
+                }
+            }
+            max_depth = (float)max_compact;
+        } else
+#ifdef RASTER_HAS_SSE2
+        if (x1 - x0 == RASTER_BLOCK_SIZE) {
+            __m128 row_max = _mm_setzero_ps();
+            for (int y = y0; y < y1; y++) {
+                const float* depth_row = g_raster_depth + y * g_raster_width + x0;
+                row_max = _mm_max_ps(row_max, _mm_max_ps(_mm_loadu_ps(depth_row), _mm_loadu_ps(depth_row + 4)));
+            }
+            row_max = _mm_max_ps(row_max, _mm_shuffle_ps(row_max, row_max, _MM_SHUFFLE(1, 0, 3, 2)));
+            row_max = _mm_max_ps(row_max, _mm_shuffle_ps(row_max, row_max, _MM_SHUFFLE(2, 3, 0, 1)));
+            max_depth = _mm_cvtss_f32(row_max);
+        } else
+#endif
+        for (int y = y0; y < y1; y++) {
+            const float* depth_row = g_raster_depth + y * g_raster_width;
+            for (int x = x0; x < x1; x++) {
+                max_depth = (depth_row[x] > max_depth) ? depth_row[x] : max_depth;
+            }
+        }
+        g_raster_block_max_depth[block] = max_depth;
+        g_raster_block_dirty[block] = 0;
+    }
+    return g_raster_block_max_depth[block];
+}
+
+// True when every block touching the pixel rectangle is already nearer than the
+// triangle's nearest point, so the depth test would fail for all of its pixels.
+static int raster_rect_occluded(const raster_triangle_t* tri, int x0, int y0, int x1, int y1) {
+    for (int by = y0 / RASTER_BLOCK_SIZE; by <= (y1 - 1) / RASTER_BLOCK_SIZE; by++) {
+        for (int bx = x0 / RASTER_BLOCK_SIZE; bx <= (x1 - 1) / RASTER_BLOCK_SIZE; bx++) {
+            if (tri->min_depth < raster_block_max_depth(bx, by)) return 0;
+        }
+    }
+    return 1;
+}
+
+static int raster_triangle_occluded_in_tile(const raster_triangle_t* tri, int tile_x0, int tile_y0, int tile_x1, int tile_y1) {
+    int x0 = (tri->x_start > tile_x0) ? tri->x_start : tile_x0;
+    int x1 = (tri->x_end < tile_x1) ? tri->x_end : tile_x1;
+    int y0 = (tri->y_start > tile_y0) ? tri->y_start : tile_y0;
+    int y1 = (tri->y_end < tile_y1) ? tri->y_end : tile_y1;
+    if (x0 >= x1 || y0 >= y1) return 1;
+    return raster_rect_occluded(tri, x0, y0, x1, y1);
+}
+
+static void raster_mark_rect_dirty(int x0, int y0, int x1, int y1) {
+    for (int by = y0 / RASTER_BLOCK_SIZE; by <= (y1 - 1) / RASTER_BLOCK_SIZE; by++) {
+        for (int bx = x0 / RASTER_BLOCK_SIZE; bx <= (x1 - 1) / RASTER_BLOCK_SIZE; bx++) {
+            g_raster_block_dirty[by * g_raster_blocks_x + bx] = 1;
+        }
+    }
+}
+
+// --- Color Packing ---
+// Interpolated colors are 0..1 floats (lighting can push them past 1) stored as
+// 0x00RRGGBB. With SSE2 the three channels convert in one instruction and the
+// saturating packs do the clamp, so no per-channel float to int conversion is left.
+#ifdef RASTER_HAS_SSE2
+static inline uint32_t raster_pack_rgb(float r, float g, float b) {
+    __m128 channels = _mm_min_ps(_mm_mul_ps(_mm_setr_ps(b, g, r, 0.0f), _mm_set1_ps(255.0f)), _mm_set1_ps(255.0f));
+    __m128i packed = _mm_cvttps_epi32(channels);
+    packed = _mm_packs_epi32(packed, packed);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+}
+#else
+static inline uint32_t raster_pack_rgb(float r, float g, float b) {
+    r = (r < 1.0f) ? ((r > 0.0f) ? r : 0.0f) : 1.0f;
+    g = (g < 1.0f) ? ((g > 0.0f) ? g : 0.0f) : 1.0f;
+    b = (b < 1.0f) ? ((b > 0.0f) ? b : 0.0f) : 1.0f;
+    return ((uint32_t)(r * 255.0f) << 16) | ((uint32_t)(g * 255.0f) << 8) | (uint32_t)(b * 255.0f);
+}
+#endif
+
+uint32_t raster_pack_color(vec3_t color) {
+    return raster_pack_rgb(color.x, color.y, color.z);
+}
+
+// Span subdivision: the exact divide runs every g_raster_perspective_step pixels and
+// depth and color are interpolated affinely in between. Over a segment whose end
+// points have w ratio q >= 1, any attribute A (depth or a color channel) is off by at
+// most |A_end - A_start| * (sqrt(q) - 1) / (sqrt(q) + 1). Affine depth lies on the
+// far side of the exact curve, so the depth test can only err towards rejecting.
+// perspective_check.c holds the walker to both.
+// Color is affine within a segment, so it is stepped in 16.16 fixed point scaled to
+// 0..255: with SSE2 one integer add advances all three channels and the pack shares
+// raster_pack_rgb's saturation. Segment ends are clamped to +-RASTER_FIXED_COLOR_LIMIT
+// so the fixed point values cannot overflow.
+#define RASTER_FIXED_COLOR_LIMIT 64.0f
+#define RASTER_FIXED_COLOR_SCALE (255.0f * 65536.0f)
+static void raster_draw_span_subdivided(const raster_triangle_t* tri, uint32_t* row, float* depth_row, int x_start, int x_end,
+                                        float w_inv, float w_inv_step, vec3_t c_pw, vec3_t c_pw_step, long* pixels_tested, long* pixels_written) {
+    long tested = 0, written = 0;
+    for (int x = x_start; x < x_end;) {
+        int n = (x_end - x < g_raster_perspective_step) ? x_end - x : g_raster_perspective_step;
+        // Anchor the segment's far end on the next segment's first pixel so the divide is
+        // shared, except at the end of the span where it sits on the last covered pixel
+        int anchor = (x + n < x_end) ? n : n - 1;
+        float w_inv_end = w_inv + w_inv_step * anchor;
+        if (w_inv <= 0 || w_inv_end <= 0) {
+            n = 1; // Extrapolated rows can cross w = 0: divide per pixel there
+            anchor = 0;
+        }
+
+        if (w_inv > 0) {
+            float z = 1.0f / w_inv;
+            float z_end = z, inv_anchor = 0.0f;
+            if (anchor > 0) {
+                z_end = 1.0f / w_inv_end;
+                inv_anchor = 1.0f / (float)anchor;
+            }
+            float z_step = (z_end - z) * inv_anchor;
+
+#ifdef RASTER_HAS_SSE2
+            const __m128 limit = _mm_set1_ps(RASTER_FIXED_COLOR_LIMIT * RASTER_FIXED_COLOR_SCALE);
+            __m128 start = _mm_mul_ps(_mm_setr_ps(c_pw.z, c_pw.y, c_pw.x, 0.0f), _mm_set1_ps(z * RASTER_FIXED_COLOR_SCALE));
+            __m128 end = _mm_mul_ps(_mm_setr_ps(c_pw.z + c_pw_step.z * anchor, c_pw.y + c_pw_step.y * anchor, c_pw.x + c_pw_step.x * anchor, 0.0f),
+                                    _mm_set1_ps(z_end * RASTER_FIXED_COLOR_SCALE));
+            start = _mm_max_ps(_mm_min_ps(start, limit), _mm_sub_ps(_mm_setzero_ps(), limit));
+            end = _mm_max_ps(_mm_min_ps(end, limit), _mm_sub_ps(_mm_setzero_ps(), limit));
+            __m128i packed_color = _mm_cvttps_epi32(start);
+            __m128i packed_step = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(end, start), _mm_set1_ps(inv_anchor)));
+#else
+            float color[3] = {c_pw.x * z, c_pw.y * z, c_pw.z * z};
+            float color_end[3] = {(c_pw.x + c_pw_step.x * anchor) * z_end, (c_pw.y + c_pw_step.y * anchor) * z_end, (c_pw.z + c_pw_step.z * anchor) * z_end};
+            int fixed[3], fixed_step[3];
+            for (int c = 0; c < 3; c++) {
+                float start = (color[c] < RASTER_FIXED_COLOR_LIMIT) ? ((color[c] > -RASTER_FIXED_COLOR_LIMIT) ? color[c] : -RASTER_FIXED_COLOR_LIMIT) : RASTER_FIXED_COLOR_LIMIT;
+                float end = (color_end[c] < RASTER_FIXED_COLOR_LIMIT) ? ((color_end[c] > -RASTER_FIXED_COLOR_LIMIT) ? color_end[c] : -RASTER_FIXED_COLOR_LIMIT) : RASTER_FIXED_COLOR_LIMIT;
+                fixed[c] = (int)(start * RASTER_FIXED_COLOR_SCALE);
+                fixed_step[c] = (int)((end - start) * RASTER_FIXED_COLOR_SCALE * inv_anchor);
+            }
+#endif
+
+            tested += n;
+            for (int i = 0; i < n; i++) {
+                if (z < depth_row[x + i]) {
+                    if (tri->is_flat) {
+                        row[x + i] = tri->flat_color;
+                    } else {
+#ifdef RASTER_HAS_SSE2
+                        __m128i pixel = _mm_srai_epi32(packed_color, 16);
+                        pixel = _mm_packs_epi32(pixel, pixel);
+                        row[x + i] = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(pixel, pixel));
+#else
+                        int r = fixed[0] >> 16, g = fixed[1] >> 16, b = fixed[2] >> 16;
+                        r = (r < 255) ? ((r > 0) ? r : 0) : 255;
+                        g = (g < 255) ? ((g > 0) ? g : 0) : 255;
+                        b = (b < 255) ? ((b > 0) ? b : 0) : 255;
+                        row[x + i] = ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+#endif
+                    }
+                    depth_row[x + i] = z;
+                    written++;
+                }
+                z += z_step;
+#ifdef RASTER_HAS_SSE2
+                packed_color = _mm_add_epi32(packed_color, packed_step);
+#else
+                fixed[0] += fixed_step[0];
+                fixed[1] += fixed_step[1];
+                fixed[2] += fixed_step[2];
+#endif
+            }
+        }
+        x += n;
+        w_inv += w_inv_step * n;
+        c_pw.x += c_pw_step.x * n;
+        c_pw.y += c_pw_step.y * n;
+        c_pw.z += c_pw_step.z * n;
+    }
+    *pixels_tested += tested;
+    *pixels_written += written;
+}
+
+// Span with a 16/24-bit depth buffer: depth is stepped in fixed point with 16 fraction
+// bits, and the divide for color only happens once a pixel has passed the test
+#define RASTER_COMPACT_SPAN_LOOP(LOAD, STORE)                                            \
+    for (int x = x_start; x < x_end; x++) {                                              \
+        if (w_inv > 0) {                                                                 \
+            int64_t value = depth >> 16;                                                 \
+            uint32_t z = (uint32_t)((value < 0) ? 0 : (value > depth_max) ? depth_max : value); \
+            tested++;                                                                    \
+            if (z < (LOAD)) {                                                            \
+                if (is_flat) {                                                           \
+                    row[x] = flat_color;                                                 \
+                } else {                                                                 \
+                    float w = 1.0f / w_inv;                                              \
+                    row[x] = raster_pack_rgb(c_pw.x * w, c_pw.y * w, c_pw.z * w);        \
+                }                                                                        \
+                STORE;                                                                   \
+                written++;                                                               \
+            }                                                                            \
+        }                                                                                \
+        depth += depth_step;                                                             \
+        w_inv += w_inv_step;                                                             \
+        c_pw.x += c_pw_step.x;                                                           \
+        c_pw.y += c_pw_step.y;                                                           \
+        c_pw.z += c_pw_step.z;                                                           \
+    }
+static void raster_draw_span_compact(const raster_triangle_t* tri, uint32_t* row, int row_index, int x_start, int x_end,
+                                     float w_inv, float w_inv_step, vec3_t c_pw, vec3_t c_pw_step, long* pixels_tested, long* pixels_written) {
+    long tested = 0, written = 0;
+    const int is_flat = tri->is_flat;
+    const uint32_t flat_color = tri->flat_color;
+    const int64_t depth_max = (int64_t)raster_compact_depth_max();
+    int64_t depth = (int64_t)((g_raster_depth_inv_near - w_inv) * g_raster_depth_scale * 65536.0f);
+    int64_t depth_step = (int64_t)(-w_inv_step * g_raster_depth_scale * 65536.0f);
+
+    if (g_raster_depth_format == RASTER_DEPTH_UNORM16) {
+        uint16_t* depth_row = (uint16_t*)g_raster_depth_compact + row_index;
+        RASTER_COMPACT_SPAN_LOOP(depth_row[x], depth_row[x] = (uint16_t)z)
+    } else {
+        uint8_t* depth_row = g_raster_depth_compact + row_index * 3;
+        RASTER_COMPACT_SPAN_LOOP(depth_row[x * 3] | (depth_row[x * 3 + 1] << 8) | ((uint32_t)depth_row[x * 3 + 2] << 16),
+                                 (depth_row[x * 3] = (uint8_t)z, depth_row[x * 3 + 1] = (uint8_t)(z >> 8), depth_row[x * 3 + 2] = (uint8_t)(z >> 16)))
+    }
+    *pixels_tested += tested;
+    *pixels_written += written;
+}
+#undef RASTER_COMPACT_SPAN_LOOP
+
+// --- Coverage ---
+static inline float raster_edge_row(const raster_triangle_t* tri, int e, int y) {
+    return tri->edge_dx[e] * (((float)y + 0.5f) - tri->edge_ay[e]);
+}
+
+static inline int raster_edge_covers(const raster_triangle_t* tri, int e, float row_term, int x) {
+    float value = row_term - tri->edge_dy[e] * (((float)x + 0.5f) - tri->edge_ax[e]);
+    return tri->edge_owns_ties[e] ? (value >= 0.0f) : (value > 0.0f);
+}
+
+// Covered columns of row y within [x_min, x_max). Each edge function is monotonic along
+// the row, so its crossing is estimated and then moved onto the exact column by testing
+// the same expression the block walker evaluates per pixel. Every walker takes its
+// coverage from here or from that expression, so all modes cover the same pixels.
+static void raster_row_coverage(const raster_triangle_t* tri, int y, int x_min, int x_max, int* x_start, int* x_end) {
+    int lo = x_min, hi = x_max;
+    for (int e = 0; e < 3 && lo < hi; e++) {
+        float row_term = raster_edge_row(tri, e, y);
+        float dy = tri->edge_dy[e];
+        if (dy == 0.0f) { // Horizontal: the whole row is on one side
+            if (!raster_edge_covers(tri, e, row_term, lo)) hi = lo;
+            continue;
+        }
+        float crossing = tri->edge_ax[e] + ((float)y + 0.5f - tri->edge_ay[e]) * tri->edge_slope[e] - 0.5f;
+        crossing = (crossing > (float)lo) ? ((crossing < (float)hi) ? crossing : (float)hi) : (float)lo;
+        int x = (int)crossing;
+        if (dy < 0.0f) { // Inside lies to the right: the edge bounds the row on the left
+            while (x > lo && raster_edge_covers(tri, e, row_term, x - 1)) x--;
+            while (x < hi && !raster_edge_covers(tri, e, row_term, x)) x++;
+            lo = x;
+        } else {
+            while (x > lo && !raster_edge_covers(tri, e, row_term, x - 1)) x--;
+            while (x < hi && raster_edge_covers(tri, e, row_term, x)) x++;
+            hi = x;
+        }
+    }
+    *x_start = lo;
+    *x_end = hi;
+}
+
+// Attribute a (0 = 1/w, 1..3 = color/w) at the start of row y; adding
+// attr_dx[a] * (x - attr_ox) gives pixel x
+static inline float raster_row_attribute(const raster_triangle_t* tri, int a, int y) {
+    return tri->attr_p0[a] + tri->attr_dy[a] * ((float)y - tri->attr_oy);
+}
+
+static void raster_draw_triangle_in_tile(const raster_triangle_t* tri, int tile_x0, int tile_y0, int tile_x1, int tile_y1, raster_stats_t* stats) {
+    int y_start = (tri->y_start > tile_y0) ? tri->y_start : tile_y0;
+    int y_end = (tri->y_end < tile_y1) ? tri->y_end : tile_y1;
+
+    int band_x0 = (tri->x_start > tile_x0) ? tri->x_start : tile_x0;
+    int band_x1 = (tri->x_end < tile_x1) ? tri->x_end : tile_x1;
+    if (y_start >= y_end || band_x0 >= band_x1) return;
+
+    long pixels_tested = 0, pixels_written = 0;
+    const float w_inv_dx = tri->attr_dx[0];
+    const vec3_t c_pw_dx = {tri->attr_dx[1], tri->attr_dx[2], tri->attr_dx[3]};
+
+    for (int y = y_start; y < y_end; y++) {
+        // Skip whole 8-row bands whose blocks are all in front of the triangle
+        if (y == y_start || y % RASTER_BLOCK_SIZE == 0) {
+            int band_y1 = (y / RASTER_BLOCK_SIZE + 1) * RASTER_BLOCK_SIZE;
+            band_y1 = (band_y1 < y_end) ? band_y1 : y_end;
+            if (raster_rect_occluded(tri, band_x0, y, band_x1, band_y1)) {
+                y = band_y1 - 1;
+                continue;
+            }
+            raster_mark_rect_dirty(band_x0, y, band_x1, band_y1);
+        }
+
+        int x_start, x_end;
+        raster_row_coverage(tri, y, band_x0, band_x1, &x_start, &x_end);
+        if (x_start >= x_end) continue;
+
+        float w_inv_row = raster_row_attribute(tri, 0, y);
+        vec3_t c_pw_row = {0, 0, 0};
+        if (!tri->is_flat) {
+            c_pw_row = (vec3_t){raster_row_attribute(tri, 1, y), raster_row_attribute(tri, 2, y), raster_row_attribute(tri, 3, y)};
+        }
+
+        uint32_t* row = g_raster_color + y * g_raster_width;
+        float* depth_row = g_raster_depth + y * g_raster_width;
+
+        if (g_raster_depth_format != RASTER_DEPTH_FLOAT32 || g_raster_perspective_step > 1) {
+            float offset = (float)x_start - tri->attr_ox;
+            float current_w_inv = w_inv_row + w_inv_dx * offset;
+            vec3_t c_pw_step = {0, 0, 0}, current_c_pw = {0, 0, 0};
+            if (!tri->is_flat) {
+                c_pw_step = c_pw_dx;
+                current_c_pw = vec3_add(c_pw_row, vec3_scale(c_pw_dx, offset));
+            }
+            if (g_raster_depth_format != RASTER_DEPTH_FLOAT32) {
+                raster_draw_span_compact(tri, row, y * g_raster_width, x_start, x_end, current_w_inv, w_inv_dx, current_c_pw, c_pw_step, &pixels_tested, &pixels_written);
+            } else {
+                raster_draw_span_subdivided(tri, row, depth_row, x_start, x_end, current_w_inv, w_inv_dx, current_c_pw, c_pw_step, &pixels_tested, &pixels_written);
+            }
+            continue;
+        }
+
+        // Each pixel is evaluated from the row start rather than stepped, so the block
+        // walker's four-wide evaluation gives bit-identical values
+        const float attr_ox = tri->attr_ox;
+        float column = (float)x_start; // Exact: whole numbers step without rounding
+        if (tri->is_flat) {
+            for (int x = x_start; x < x_end; x++, column += 1.0f) {
+                float w_inv = w_inv_row + w_inv_dx * (column - attr_ox);
+                if (w_inv > 0) {
+                    float z = 1.0f / w_inv;
+                    pixels_tested++;
+                    if (z < depth_row[x]) {
+                        row[x] = tri->flat_color;
+                        depth_row[x] = z;
+                        pixels_written++;
+                    }
+                }
+            }
+            continue;
+        }
+
+        for (int x = x_start; x < x_end; x++, column += 1.0f) {
+            float offset = column - attr_ox;
+            float w_inv = w_inv_row + w_inv_dx * offset;
+            if (w_inv > 0) {
+                float z = 1.0f / w_inv;
+                pixels_tested++;
+                if (z < depth_row[x]) {
+                    float r_pw = c_pw_row.x + c_pw_dx.x * offset;
+                    float g_pw = c_pw_row.y + c_pw_dx.y * offset;
+                    float b_pw = c_pw_row.z + c_pw_dx.z * offset;
+                    row[x] = raster_pack_rgb(r_pw * z, g_pw * z, b_pw * z);
+                    depth_row[x] = z;
+                    pixels_written++;
+                }
+            }
+        }
+    }
+    stats->pixels_tested += pixels_tested;
+    stats->pixels_written += pixels_written;
+}
+
+// --- Small Triangles ---
+// Triangles whose pixel centers fit in a RASTER_SMALL_TRIANGLE_SIZE square, which is most
+// of a distant high-poly mesh, skip the walkers: no coarse depth per band or block, no
+// span stepping, and the same path in every mode. Each pixel is interpolated on its own.
+static void raster_draw_small_triangle(const raster_triangle_t* tri, int tile_x0, int tile_y0, int tile_x1, int tile_y1, raster_stats_t* stats) {
+    int y_start = (tri->y_start > tile_y0) ? tri->y_start : tile_y0;
+    int y_end = (tri->y_end < tile_y1) ? tri->y_end : tile_y1;
+    int x_min = (tri->x_start > tile_x0) ? tri->x_start : tile_x0;
+    int x_max = (tri->x_end < tile_x1) ? tri->x_end : tile_x1;
+    if (y_start >= y_end || x_min >= x_max) return;
+    raster_mark_rect_dirty(x_min, y_start, x_max, y_end);
+
+    for (int y = y_start; y < y_end; y++) {
+        int x_start, x_end;
+        raster_row_coverage(tri, y, x_min, x_max, &x_start, &x_end);
+        if (x_start >= x_end) continue;
+        float w_inv_row = raster_row_attribute(tri, 0, y);
+
+        for (int x = x_start; x < x_end; x++) {
+            float offset = (float)x - tri->attr_ox;
+            float w_inv = w_inv_row + tri->attr_dx[0] * offset;
+            if (w_inv <= 0) continue;
+            float z = 1.0f / w_inv;
+            int index = y * g_raster_width + x;
+            stats->pixels_tested++;
+            if (g_raster_depth_format == RASTER_DEPTH_FLOAT32) {
+                if (!(z < g_raster_depth[index])) continue;
+                g_raster_depth[index] = z;
+            } else {
+                uint32_t compact = raster_compact_depth_from_w(z);
+                if (compact >= raster_load_compact_depth(index)) continue;
+                raster_store_compact_depth(index, compact);
+            }
+            if (tri->is_flat) {
+                g_raster_color[index] = tri->flat_color;
+            } else {
+                float r_pw = raster_row_attribute(tri, 1, y) + tri->attr_dx[1] * offset;
+                float g_pw = raster_row_attribute(tri, 2, y) + tri->attr_dx[2] * offset;
+                float b_pw = raster_row_attribute(tri, 3, y) + tri->attr_dx[3] * offset;
+                g_raster_color[index] = raster_pack_rgb(r_pw * z, g_pw * z, b_pw * z);
+            }
+            stats->pixels_written++;
+        }
+    }
+}
+
+// --- Span Buffer ---
+// RASTER_MODE_SBUFFER: each row of a tile keeps a sorted list of non-overlapping spans,
+// every one owned by the nearest triangle seen there so far. Triangles are inserted
+// front to back and clipped against the spans already in the row (1/w is linear along
+// a row, so two triangles swap order at most once within an overlap). Once the whole
+// bin is in, every row is shaded: one depth test and one color per covered pixel, no
+// matter how many faces overlap it. The depth test is still done so direct writes
+// (lines, points) keep hiding triangles behind them.
+typedef struct {
+    float w_inv_a, w_inv_b; // 1/w at pixel x is a + b * x
+    vec3_t c_pw_a, c_pw_b;  // Color / w, likewise (zero for flat triangles)
+    int triangle;           // Index into g_raster_triangles
+} raster_segment_t;
+
+typedef struct {
+    int x0, x1;             // Pixels [x0, x1)
+    int segment;
+} raster_span_t;
+
+typedef struct {
+    raster_span_t spans[RASTER_TILE_SIZE][RASTER_TILE_SIZE]; // Per tile row; spans are never empty, so a row holds at most one per pixel
+    int span_count[RASTER_TILE_SIZE];
+    raster_segment_t* segments; // One per triangle row that won at least one pixel
+    int segment_count;
+    int segment_capacity;
+    int* order;                 // The bin's triangles, nearest first
+    int order_capacity;
+} raster_sbuffer_t;
+
+// One per thread taking part in a flush (slot 0 is the caller's), made on first use and
+// kept until raster_shutdown(); only the row counts are reset per tile
+static raster_sbuffer_t* g_raster_sbuffers[RASTER_MAX_THREADS];
+
+static int raster_compare_min_depth(const void* a, const void* b) {
+    float da = g_raster_triangles[*(const int*)a].min_depth;
+    float db = g_raster_triangles[*(const int*)b].min_depth;
+    return (da < db) ? -1 : (da > db) ? 1 : (*(const int*)a - *(const int*)b);
+}
+
+static inline void raster_sbuffer_push(raster_span_t* out, int* count, int x0, int x1, int segment) {
+    if (x0 >= x1) return;
+    if (*count > 0 && out[*count - 1].segment == segment && out[*count - 1].x1 == x0) {
+        out[*count - 1].x1 = x1; // Merge with the piece before it
+        return;
+    }
+    out[*count].x0 = x0;
+    out[*count].x1 = x1;
+    out[*count].segment = segment;
+    (*count)++;
+}
+
+// Inserts [x_start, x_end) of a segment into a row. Returns 1 if the segment won any pixel.
+static int raster_sbuffer_insert(raster_sbuffer_t* sbuffer, int row, int x_start, int x_end, int segment) {
+    const raster_segment_t* seg = &sbuffer->segments[segment];
+    const raster_span_t* spans = sbuffer->spans[row];
+    int count = sbuffer->span_count[row];
+    raster_span_t out[RASTER_TILE_SIZE];
+    int out_count = 0;
+    int used = 0;
+    int x = x_start; // Where the part of the new span not yet placed begins
+
+    for (int i = 0; i < count; i++) {
+        raster_span_t old = spans[i];
+        if (old.x1 <= x_start) {
+            raster_sbuffer_push(out, &out_count, old.x0, old.x1, old.segment);
+            continue;
+        }
+        if (old.x0 >= x_end) {
+            if (x < x_end) {
+                raster_sbuffer_push(out, &out_count, x, x_end, segment);
+                used = 1;
+                x = x_end;
+            }
+            raster_sbuffer_push(out, &out_count, old.x0, old.x1, old.segment);
+            continue;
+        }
+
+        raster_sbuffer_push(out, &out_count, old.x0, x_start, old.segment); // Left of the new span
+        if (x < old.x0) {
+            raster_sbuffer_push(out, &out_count, x, old.x0, segment); // Gap nothing covered yet
+            used = 1;
+        }
+
+        // Overlap: the larger 1/w is nearer; ties keep what was there, like the depth test
+        int o0 = (old.x0 > x_start) ? old.x0 : x_start;
+        int o1 = (old.x1 < x_end) ? old.x1 : x_end;
+        const raster_segment_t* other = &sbuffer->segments[old.segment];
+        float da = seg->w_inv_a - other->w_inv_a;
+        float db = seg->w_inv_b - other->w_inv_b;
+        int new_first = (da + db * (float)o0) > 0.0f;
+        int new_last = (da + db * (float)(o1 - 1)) > 0.0f;
+        if (new_first == new_last) {
+            raster_sbuffer_push(out, &out_count, o0, o1, new_first ? segment : old.segment);
+        } else {
+            // First pixel past the crossing, where the other triangle takes over
+            float crossing = -da / db;
+            int split = new_first ? (int)ceilf(crossing) : (int)floorf(crossing) + 1;
+            split = (split < o0 + 1) ? o0 + 1 : (split > o1 - 1) ? o1 - 1 : split;
+            raster_sbuffer_push(out, &out_count, o0, split, new_first ? segment : old.segment);
+            raster_sbuffer_push(out, &out_count, split, o1, new_first ? old.segment : segment);
+        }
+        used |= new_first | new_last;
+        x = o1;
+
+        raster_sbuffer_push(out, &out_count, x_end, old.x1, old.segment); // Right of the new span
+    }
+    if (x < x_end) {
+        raster_sbuffer_push(out, &out_count, x, x_end, segment);
+        used = 1;
+    }
+
+    memcpy(sbuffer->spans[row], out, out_count * sizeof(raster_span_t));
+    sbuffer->span_count[row] = out_count;
+    return used;
+}
+
+// Adds every row of a triangle to the tile's span lists. Returns 0 if the segment pool
+// could not grow; the caller then falls back to the span walker for what is left.
+static int raster_sbuffer_add_triangle(raster_sbuffer_t* sbuffer, int triangle_index, int tile_x0, int tile_y0, int tile_x1, int tile_y1) {
+    const raster_triangle_t* tri = &g_raster_triangles[triangle_index];
+    int y_start = (tri->y_start > tile_y0) ? tri->y_start : tile_y0;
+    int y_end = (tri->y_end < tile_y1) ? tri->y_end : tile_y1;
+
+    int x_min = (tri->x_start > tile_x0) ? tri->x_start : tile_x0;
+    int x_max = (tri->x_end < tile_x1) ? tri->x_end : tile_x1;
+
+    for (int y = y_start; y < y_end; y++) {
+        int x_start, x_end;
+        raster_row_coverage(tri, y, x_min, x_max, &x_start, &x_end);
+        if (x_start >= x_end) continue;
+
+        if (sbuffer->segment_count >= sbuffer->segment_capacity) {
+            int new_capacity = (sbuffer->segment_capacity == 0) ? 1024 : sbuffer->segment_capacity * 2;
+            raster_segment_t* new_segments = (raster_segment_t*)realloc(sbuffer->segments, new_capacity * sizeof(raster_segment_t));
+            if (!new_segments) return 0;
+            sbuffer->segments = new_segments;
+            sbuffer->segment_capacity = new_capacity;
+        }
+        raster_segment_t* seg = &sbuffer->segments[sbuffer->segment_count];
+        seg->w_inv_b = tri->attr_dx[0];
+        seg->w_inv_a = raster_row_attribute(tri, 0, y) - tri->attr_dx[0] * tri->attr_ox;
+        seg->c_pw_b = (vec3_t){0, 0, 0};
+        seg->c_pw_a = (vec3_t){0, 0, 0};
+        if (!tri->is_flat) {
+            seg->c_pw_b = (vec3_t){tri->attr_dx[1], tri->attr_dx[2], tri->attr_dx[3]};
+            seg->c_pw_a = (vec3_t){raster_row_attribute(tri, 1, y) - tri->attr_dx[1] * tri->attr_ox,
+                                   raster_row_attribute(tri, 2, y) - tri->attr_dx[2] * tri->attr_ox,
+                                   raster_row_attribute(tri, 3, y) - tri->attr_dx[3] * tri->attr_ox};
+        }
+        seg->triangle = triangle_index;
+        if (raster_sbuffer_insert(sbuffer, y - tile_y0, x_start, x_end, sbuffer->segment_count)) {
+            sbuffer->segment_count++; // Rows that lost everywhere reuse the slot
+        }
+    }
+    return 1;
+}
+
+static void raster_sbuffer_resolve_row(const raster_sbuffer_t* sbuffer, int row, int y, long* pixels_tested, long* pixels_written) {
+    uint32_t* color_row = g_raster_color + y * g_raster_width;
+    float* depth_row = g_raster_depth + y * g_raster_width;
+    long tested = 0, written = 0;
+
+    for (int i = 0; i < sbuffer->span_count[row]; i++) {
+        const raster_span_t* span = &sbuffer->spans[row][i];
+        const raster_segment_t* seg = &sbuffer->segments[span->segment];
+        const raster_triangle_t* tri = &g_raster_triangles[seg->triangle];
+        float w_inv = seg->w_inv_a + seg->w_inv_b * (float)span->x0;
+
+        if (tri->is_flat) {
+            for (int x = span->x0; x < span->x1; x++) {
+                if (w_inv > 0) {
+                    float z = 1.0f / w_inv;
+                    tested++;
+                    if (z < depth_row[x]) {
+                        color_row[x] = tri->flat_color;
+                        depth_row[x] = z;
+                        written++;
+                    }
+                }
+                w_inv += seg->w_inv_b;
+            }
+            continue;
+        }
+
+        vec3_t c_pw = vec3_add(seg->c_pw_a, vec3_scale(seg->c_pw_b, (float)span->x0));
+        for (int x = span->x0; x < span->x1; x++) {
+            if (w_inv > 0) {
+                float z = 1.0f / w_inv;
+                tested++;
+                if (z < depth_row[x]) {
+                    color_row[x] = raster_pack_rgb(c_pw.x * z, c_pw.y * z, c_pw.z * z);
+                    depth_row[x] = z;
+                    written++;
+                }
+            }
+            c_pw.x += seg->c_pw_b.x;
+            c_pw.y += seg->c_pw_b.y;
+            c_pw.z += seg->c_pw_b.z;
+            w_inv += seg->w_inv_b;
+        }
+    }
+    *pixels_tested += tested;
+    *pixels_written += written;
+}
+
+static void raster_draw_tile_sbuffer(raster_sbuffer_t* sbuffer, const raster_bin_t* bin, int tile_x0, int tile_y0, int tile_x1, int tile_y1, raster_stats_t* stats) {
+    // Front to back, so later triangles mostly lose whole overlaps instead of splitting spans
+    const int* order = bin->items;
+    if (bin->count > sbuffer->order_capacity) {
+        int* new_order = (int*)realloc(sbuffer->order, bin->count * sizeof(int));
+        if (new_order) {
+            sbuffer->order = new_order;
+            sbuffer->order_capacity = bin->count;
+        }
+    }
+    if (bin->count <= sbuffer->order_capacity) {
+        memcpy(sbuffer->order, bin->items, bin->count * sizeof(int));
+        qsort(sbuffer->order, bin->count, sizeof(int), raster_compare_min_depth);
+        order = sbuffer->order;
+    }
+
+    memset(sbuffer->span_count, 0, sizeof(sbuffer->span_count));
+    sbuffer->segment_count = 0;
+    int i = 0;
+    for (; i < bin->count; i++) {
+        const raster_triangle_t* tri = &g_raster_triangles[order[i]];
+        if (raster_triangle_occluded_in_tile(tri, tile_x0, tile_y0, tile_x1, tile_y1)) continue;
+        if (tri->is_small) {
+            raster_draw_small_triangle(tri, tile_x0, tile_y0, tile_x1, tile_y1, stats); // The resolve depth tests against it
+            continue;
+        }
+        if (!raster_sbuffer_add_triangle(sbuffer, order[i], tile_x0, tile_y0, tile_x1, tile_y1)) break;
+    }
+
+    for (int y = tile_y0; y < tile_y1; y++) {
+        raster_sbuffer_resolve_row(sbuffer, y - tile_y0, y, &stats->pixels_tested, &stats->pixels_written);
+    }
+    raster_mark_rect_dirty(tile_x0, tile_y0, tile_x1, tile_y1);
+
+    // Out of memory part way: the depth buffer is up to date, so the rest can go the usual way
+    for (; i < bin->count; i++) {
+        const raster_triangle_t* tri = &g_raster_triangles[order[i]];
+        if (raster_triangle_occluded_in_tile(tri, tile_x0, tile_y0, tile_x1, tile_y1)) continue;
+        raster_draw_triangle_in_tile(tri, tile_x0, tile_y0, tile_x1, tile_y1, stats);
+    }
+}
+
+#ifdef RASTER_HAS_SSE2
+// raster_edge_covers() for four pixel centers, with the same operations in the same order
+typedef struct {
+    __m128 ax, dy;
+    int owns_ties;
+} raster_edge_sse2_t;
+
+static inline raster_edge_sse2_t raster_load_edge_sse2(const raster_triangle_t* tri, int e) {
+    raster_edge_sse2_t edge = {_mm_set1_ps(tri->edge_ax[e]), _mm_set1_ps(tri->edge_dy[e]), tri->edge_owns_ties[e]};
+    return edge;
+}
+
+static inline __m128 raster_edge_covers_sse2(const raster_edge_sse2_t* edge, __m128 row_terms, __m128 columns) {
+    __m128 offset = _mm_sub_ps(_mm_add_ps(columns, _mm_set1_ps(0.5f)), edge->ax);
+    __m128 value = _mm_sub_ps(row_terms, _mm_mul_ps(edge->dy, offset));
+    return edge->owns_ties ? _mm_cmpge_ps(value, _mm_setzero_ps()) : _mm_cmpgt_ps(value, _mm_setzero_ps());
+}
+
+// Shades columns [col0, col1) of rows [row0, row1), four pixels per step. Row r of the
+// block starts with edge_rows[e][r] and attr_rows[a][r]. A fully covered block skips the
+// edge tests; otherwise every group evaluates the three edge functions. Groups are
+// aligned to 4 pixels and never touch memory at or beyond x_limit (the tile edge).
+static void raster_shade_block_sse2(const raster_triangle_t* tri, int col0, int col1, int row0, int row1, int fully_covered,
+                                    float edge_rows[3][RASTER_BLOCK_SIZE], float attr_rows[4][RASTER_BLOCK_SIZE], int x_limit, raster_stats_t* stats) {
+    static const int lane_counts[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale_255 = _mm_set1_ps(255.0f);
+    const __m128 offset_x = _mm_set1_ps(tri->attr_ox);
+    const __m128 w_inv_dx = _mm_set1_ps(tri->attr_dx[0]);
+    const __m128 r_dx = _mm_set1_ps(tri->attr_dx[1]), g_dx = _mm_set1_ps(tri->attr_dx[2]), b_dx = _mm_set1_ps(tri->attr_dx[3]);
+    const __m128i lane_index = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i zero_i = _mm_setzero_si128();
+    const __m128i first_x = _mm_set1_epi32(col0 - 1);
+    const __m128i end_x = _mm_set1_epi32(col1);
+    const __m128i flat_color = _mm_set1_epi32((int)tri->flat_color);
+    const int is_flat = tri->is_flat;
+    raster_edge_sse2_t edges[3] = {raster_load_edge_sse2(tri, 0), raster_load_edge_sse2(tri, 1), raster_load_edge_sse2(tri, 2)};
+    long pixels_tested = 0, pixels_written = 0;
+
+    for (int y = row0; y < row1; y++) {
+        int r = y - row0;
+        uint32_t* row = g_raster_color + y * g_raster_width;
+        float* depth_row = g_raster_depth + y * g_raster_width;
+        const __m128 edge_row_0 = _mm_set1_ps(edge_rows[0][r]), edge_row_1 = _mm_set1_ps(edge_rows[1][r]), edge_row_2 = _mm_set1_ps(edge_rows[2][r]);
+        const __m128 w_inv_row = _mm_set1_ps(attr_rows[0][r]);
+        __m128 r_row = zero, g_row = zero, b_row = zero;
+        if (!is_flat) {
+            r_row = _mm_set1_ps(attr_rows[1][r]);
+            g_row = _mm_set1_ps(attr_rows[2][r]);
+            b_row = _mm_set1_ps(attr_rows[3][r]);
+        }
+
+        for (int x = col0 & ~3; x < col1; x += 4) {
+            __m128i lane_x = _mm_add_epi32(_mm_set1_epi32(x), lane_index);
+            __m128 columns = _mm_cvtepi32_ps(lane_x);
+            __m128 mask = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(lane_x, first_x), _mm_cmplt_epi32(lane_x, end_x)));
+            if (!fully_covered) {
+                mask = _mm_and_ps(mask, raster_edge_covers_sse2(&edges[0], edge_row_0, columns));
+                mask = _mm_and_ps(mask, raster_edge_covers_sse2(&edges[1], edge_row_1, columns));
+                mask = _mm_and_ps(mask, raster_edge_covers_sse2(&edges[2], edge_row_2, columns));
+            }
+
+            __m128 offset = _mm_sub_ps(columns, offset_x);
+            __m128 w_inv = _mm_add_ps(w_inv_row, _mm_mul_ps(w_inv_dx, offset));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(w_inv, zero));
+            int test_mask = _mm_movemask_ps(mask);
+            if (!test_mask) continue;
+
+            int lanes = (x_limit - x < 4) ? x_limit - x : 4;
+            __m128 old_depth;
+            if (lanes == 4) {
+                old_depth = _mm_loadu_ps(depth_row + x);
+            } else {
+                float depth_in[4] = {0, 0, 0, 0};
+                for (int i = 0; i < lanes; i++) depth_in[i] = depth_row[x + i];
+                old_depth = _mm_loadu_ps(depth_in);
+            }
+
+            __m128 z = _mm_div_ps(one, w_inv);
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(z, old_depth));
+            int write_mask = _mm_movemask_ps(mask);
+            pixels_tested += lane_counts[test_mask];
+            pixels_written += lane_counts[write_mask];
+            if (!write_mask) continue;
+
+            __m128i color = flat_color;
+            if (!is_flat) {
+                // raster_pack_rgb() per lane: scale, clamp above, truncate, clamp below
+                __m128 r_pw = _mm_add_ps(r_row, _mm_mul_ps(r_dx, offset));
+                __m128 g_pw = _mm_add_ps(g_row, _mm_mul_ps(g_dx, offset));
+                __m128 b_pw = _mm_add_ps(b_row, _mm_mul_ps(b_dx, offset));
+                __m128i red = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_mul_ps(r_pw, z), scale_255), scale_255));
+                __m128i green = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_mul_ps(g_pw, z), scale_255), scale_255));
+                __m128i blue = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_mul_ps(b_pw, z), scale_255), scale_255));
+                red = _mm_and_si128(red, _mm_cmpgt_epi32(red, zero_i));
+                green = _mm_and_si128(green, _mm_cmpgt_epi32(green, zero_i));
+                blue = _mm_and_si128(blue, _mm_cmpgt_epi32(blue, zero_i));
+                color = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(red, 16), _mm_slli_epi32(green, 8)), blue);
+            }
+
+            if (write_mask == 0xF && lanes == 4) {
+                _mm_storeu_si128((__m128i*)(row + x), color);
+                _mm_storeu_ps(depth_row + x, z);
+            } else {
+                uint32_t color_out[4];
+                float depth_out[4];
+                _mm_storeu_si128((__m128i*)color_out, color);
+                _mm_storeu_ps(depth_out, z);
+                for (int i = 0; i < lanes; i++) {
+                    if (write_mask & (1 << i)) { row[x + i] = color_out[i]; depth_row[x + i] = depth_out[i]; }
+                }
+            }
+        }
+    }
+    stats->pixels_tested += pixels_tested;
+    stats->pixels_written += pixels_written;
+}
+
+// Walks the triangle's bounding box inside the tile in 8x8 blocks. The edge functions
+// only ever grow or shrink along a row or a column (each rounding step is monotonic), so
+// their values at the four corner pixels bound them over the block: a block where some
+// edge rejects all four corners is skipped, one where every edge accepts all four is
+// shaded without coverage tests, and the rest test coverage per 4-pixel group.
+static void raster_draw_triangle_in_tile_halfspace(const raster_triangle_t* tri, int tile_x0, int tile_y0, int tile_x1, int tile_y1, raster_stats_t* stats) {
+    int y0 = (tri->y_start > tile_y0) ? tri->y_start : tile_y0;
+    int y1 = (tri->y_end < tile_y1) ? tri->y_end : tile_y1;
+    int x0 = (tri->x_start > tile_x0) ? tri->x_start : tile_x0;
+    int x1 = (tri->x_end < tile_x1) ? tri->x_end : tile_x1;
+    if (y0 >= y1 || x0 >= x1) return;
+
+    int block_x0 = tile_x0 + ((x0 - tile_x0) & ~(RASTER_BLOCK_SIZE - 1));
+    int block_y0 = tile_y0 + ((y0 - tile_y0) & ~(RASTER_BLOCK_SIZE - 1));
+    int attr_count = tri->is_flat ? 1 : 4;
+    float edge_rows[3][RASTER_BLOCK_SIZE], attr_rows[4][RASTER_BLOCK_SIZE];
+
+    for (int by = block_y0; by < y1; by += RASTER_BLOCK_SIZE) {
+        int row0 = (by > y0) ? by : y0;
+        int row1 = (by + RASTER_BLOCK_SIZE < y1) ? by + RASTER_BLOCK_SIZE : y1;
+        for (int y = row0; y < row1; y++) {
+            for (int e = 0; e < 3; e++) edge_rows[e][y - row0] = raster_edge_row(tri, e, y);
+            for (int a = 0; a < attr_count; a++) attr_rows[a][y - row0] = raster_row_attribute(tri, a, y);
+        }
+        int last_row = row1 - 1 - row0;
+
+        for (int bx = block_x0; bx < x1; bx += RASTER_BLOCK_SIZE) {
+            int col0 = (bx > x0) ? bx : x0;
+            int col1 = (bx + RASTER_BLOCK_SIZE < x1) ? bx + RASTER_BLOCK_SIZE : x1;
+
+            __m128 corner_columns = _mm_setr_ps((float)col0, (float)(col1 - 1), (float)col0, (float)(col1 - 1));
+            int fully_covered = 1, rejected = 0;
+            for (int e = 0; e < 3 && !rejected; e++) {
+                raster_edge_sse2_t edge = raster_load_edge_sse2(tri, e);
+                __m128 corner_rows = _mm_setr_ps(edge_rows[e][0], edge_rows[e][0], edge_rows[e][last_row], edge_rows[e][last_row]);
+                int corners = _mm_movemask_ps(raster_edge_covers_sse2(&edge, corner_rows, corner_columns));
+                rejected = (corners == 0);
+                fully_covered &= (corners == 0xF);
+            }
+            if (rejected) continue;
+
+            int block_x = bx / RASTER_BLOCK_SIZE, block_y = by / RASTER_BLOCK_SIZE;
+            if (tri->min_depth >= raster_block_max_depth(block_x, block_y)) continue; // Block is already nearer
+            g_raster_block_dirty[block_y * g_raster_blocks_x + block_x] = 1;
+
+            raster_shade_block_sse2(tri, col0, col1, row0, row1, fully_covered, edge_rows, attr_rows, tile_x1, stats);
+        }
+    }
+}
+#endif
+
+// Pulls tiles off the shared counter until none are left. Runs on the workers and the caller,
+// each with its own slot.
+static void raster_process_tiles(int slot) {
+    int tile_count = g_raster_tiles_x * g_raster_tiles_y;
+    raster_stats_t stats = {0, 0};
+    raster_sbuffer_t* sbuffer = NULL; // Falls back to the span walker if it cannot be had
+    if (g_raster_mode == RASTER_MODE_SBUFFER && g_raster_depth_format == RASTER_DEPTH_FLOAT32) {
+        if (!g_raster_sbuffers[slot]) g_raster_sbuffers[slot] = (raster_sbuffer_t*)calloc(1, sizeof(raster_sbuffer_t));
+        sbuffer = g_raster_sbuffers[slot];
+    }
+    for (;;) {
+        int tile = (int)platform_atomic_increment(&g_raster_next_tile) - 1;
+        if (tile >= tile_count) break;
+
+        raster_bin_t* bin = &g_raster_bins[tile];
+        if (bin->count == 0) continue;
+        if (g_raster_lazy_depth_clear) raster_prepare_depth_tile(tile);
+
+        int tile_x0 = (tile % g_raster_tiles_x) * RASTER_TILE_SIZE;
+        int tile_y0 = (tile / g_raster_tiles_x) * RASTER_TILE_SIZE;
+        int tile_x1 = (tile_x0 + RASTER_TILE_SIZE < g_raster_width) ? tile_x0 + RASTER_TILE_SIZE : g_raster_width;
+        int tile_y1 = (tile_y0 + RASTER_TILE_SIZE < g_raster_height) ? tile_y0 + RASTER_TILE_SIZE : g_raster_height;
+
+#ifdef RASTER_HAS_SSE2
+        if (g_raster_mode == RASTER_MODE_HALFSPACE && g_raster_depth_format == RASTER_DEPTH_FLOAT32) {
+            for (int i = 0; i < bin->count; i++) {
+                const raster_triangle_t* tri = &g_raster_triangles[bin->items[i]];
+                if (raster_triangle_occluded_in_tile(tri, tile_x0, tile_y0, tile_x1, tile_y1)) continue;
+                if (tri->is_small) raster_draw_small_triangle(tri, tile_x0, tile_y0, tile_x1, tile_y1, &stats);
+                else raster_draw_triangle_in_tile_halfspace(tri, tile_x0, tile_y0, tile_x1, tile_y1, &stats);
+            }
+            continue;
+        }
+#endif
+        if (sbuffer) {
+            raster_draw_tile_sbuffer(sbuffer, bin, tile_x0, tile_y0, tile_x1, tile_y1, &stats);
+            continue;
+        }
+        for (int i = 0; i < bin->count; i++) {
+            const raster_triangle_t* tri = &g_raster_triangles[bin->items[i]];
+            if (raster_triangle_occluded_in_tile(tri, tile_x0, tile_y0, tile_x1, tile_y1)) continue;
+            if (tri->is_small) raster_draw_small_triangle(tri, tile_x0, tile_y0, tile_x1, tile_y1, &stats);
+            else raster_draw_triangle_in_tile(tri, tile_x0, tile_y0, tile_x1, tile_y1, &stats);
+        }
+    }
+    platform_atomic_add(&g_raster_pixels_tested, stats.pixels_tested);
+    platform_atomic_add(&g_raster_pixels_written, stats.pixels_written);
+}
+
+static int raster_worker_main(void* param) {
+    int slot = (int)(intptr_t)param;
+    for (;;) {
+        platform_semaphore_wait(g_raster_start_semaphore);
+        if (g_raster_quit) break;
+        raster_process_tiles(slot);
+        if (platform_atomic_decrement(&g_raster_workers_busy) == 0) {
+            platform_semaphore_post(g_raster_done_semaphore, 1);
+        }
+    }
+    return 0;
+}
+
+// --- Lifetime ---
+void raster_init(int thread_count) {
+    if (g_raster_start_semaphore) return; // Already running
+
+    if (thread_count <= 0) thread_count = platform_cpu_count();
+    if (thread_count > RASTER_MAX_THREADS) thread_count = RASTER_MAX_THREADS;
+
+    // The calling thread always takes part in the flush, so it counts as one of them.
+    g_raster_quit = 0;
+    g_raster_worker_count = 0;
+    g_raster_start_semaphore = platform_semaphore_create(0, RASTER_MAX_THREADS);
+    g_raster_done_semaphore = platform_semaphore_create(0, 1);
+    if (!g_raster_start_semaphore || !g_raster_done_semaphore) return;
+
+    for (int i = 0; i < thread_count - 1; i++) {
+        platform_thread_t thread = platform_thread_create(raster_worker_main, (void*)(intptr_t)(i + 1));
+        if (!thread) break;
+        g_raster_threads[g_raster_worker_count++] = thread;
+    }
+}
+
+void raster_shutdown(void) {
+    if (g_raster_start_semaphore) {
+        g_raster_quit = 1;
+        platform_semaphore_post(g_raster_start_semaphore, g_raster_worker_count);
+        for (int i = 0; i < g_raster_worker_count; i++) platform_thread_join(g_raster_threads[i]);
+        platform_semaphore_destroy(g_raster_start_semaphore);
+        platform_semaphore_destroy(g_raster_done_semaphore);
+        g_raster_start_semaphore = NULL;
+        g_raster_done_semaphore = NULL;
+        g_raster_worker_count = 0;
+    }
+
+    for (int i = 0; i < RASTER_MAX_THREADS; i++) {
+        if (!g_raster_sbuffers[i]) continue;
+        free(g_raster_sbuffers[i]->segments);
+        free(g_raster_sbuffers[i]->order);
+        free(g_raster_sbuffers[i]);
+        g_raster_sbuffers[i] = NULL;
+    }
+    for (int i = 0; i < g_raster_bin_capacity; i++) free(g_raster_bins[i].items);
+    free(g_raster_bins);
+    free(g_raster_triangles);
+    free(g_raster_block_max_depth);
+    free(g_raster_block_dirty);
+    free(g_raster_depth_compact);
+    g_raster_bins = NULL;
+    g_raster_bin_capacity = 0;
+    g_raster_triangles = NULL;
+    g_raster_triangle_capacity = 0;
+    g_raster_triangle_count = 0;
+    g_raster_block_max_depth = NULL;
+    g_raster_block_dirty = NULL;
+    g_raster_block_capacity = 0;
+    g_raster_depth_compact = NULL;
+    g_raster_depth_compact_capacity = 0;
+}
+
+void raster_configure(const char* command_line) {
+    if (!command_line) return;
+    if (strstr(command_line, "-raster=halfspace")) raster_set_mode(RASTER_MODE_HALFSPACE);
+    else if (strstr(command_line, "-raster=sbuffer")) raster_set_mode(RASTER_MODE_SBUFFER);
+    else if (strstr(command_line, "-raster=scanline")) raster_set_mode(RASTER_MODE_SCANLINE);
+
+    if (strstr(command_line, "-depth=16")) raster_set_depth_format(RASTER_DEPTH_UNORM16);
+    else if (strstr(command_line, "-depth=24")) raster_set_depth_format(RASTER_DEPTH_UNORM24);
+    else if (strstr(command_line, "-depth=float")) raster_set_depth_format(RASTER_DEPTH_FLOAT32);
+
+    if (strstr(command_line, "-depthclear=lazy")) raster_set_lazy_depth_clear(1);
+    else if (strstr(command_line, "-depthclear=full")) raster_set_lazy_depth_clear(0);
+
+    const char* perspective = strstr(command_line, "-perspective=");
+    if (perspective) {
+        perspective += strlen("-perspective=");
+        raster_set_perspective_step(strncmp(perspective, "exact", 5) == 0 ? 1 : atoi(perspective));
+    }
+}
+
+void raster_set_perspective_step(int pixels) {
+    if (pixels < 1) pixels = 1;
+    if (pixels > RASTER_MAX_PERSPECTIVE_STEP) pixels = RASTER_MAX_PERSPECTIVE_STEP;
+    g_raster_perspective_step = pixels;
+}
+
+void raster_set_lazy_depth_clear(int enabled) {
+    g_raster_lazy_depth_clear = enabled ? 1 : 0;
+}
+
+void raster_set_depth_format(raster_depth_format_t format) {
+    if (format == g_raster_depth_format) return;
+    g_raster_depth_format = format;
+    g_raster_depth_compact_capacity = 0; // Bytes per pixel changed: the next clear reallocates and refills
+    for (int i = 0; i < g_raster_bin_capacity; i++) g_raster_bins[i].depth_epoch = 0;
+}
+
+raster_depth_format_t raster_get_depth_format(void) {
+    return g_raster_depth_format;
+}
+
+void raster_set_mode(raster_mode_t mode) {
+#ifndef RASTER_HAS_SSE2
+    if (mode == RASTER_MODE_HALFSPACE) mode = RASTER_MODE_SCANLINE; // The block walker needs SSE2
+#endif
+    g_raster_mode = mode;
+}
+
+raster_mode_t raster_get_mode(void) {
+    return g_raster_mode;
+}
+
+void raster_set_depth_range(mat4_t projection, float near_distance, float far_distance) {
+    // A clip-space point maps back to view space through the inverse projection. It is
+    // nearer than the far plane when view z + far * view w >= 0 (the camera looks down -z).
+    mat4_t inverse = mat4_inverse(projection);
+    g_raster_far_plane.x = inverse.m[2][0] + far_distance * inverse.m[3][0];
+    g_raster_far_plane.y = inverse.m[2][1] + far_distance * inverse.m[3][1];
+    g_raster_far_plane.z = inverse.m[2][2] + far_distance * inverse.m[3][2];
+    g_raster_far_plane.w = inverse.m[2][3] + far_distance * inverse.m[3][3];
+
+    // Clip w of the view-space points (0, 0, -near) and (0, 0, -far). An orthographic
+    // projection has w = 1 everywhere, so every triangle gets the same compact depth,
+    // just as every one stores w = 1 in the float buffer.
+    float w_near = projection.m[3][3] - projection.m[3][2] * near_distance;
+    float w_far = projection.m[3][3] - projection.m[3][2] * far_distance;
+    if (w_near > 0.0f && w_far > w_near) {
+        g_raster_depth_inv_near = 1.0f / w_near;
+        g_raster_depth_scale = (float)raster_compact_depth_max() / (1.0f / w_near - 1.0f / w_far);
+    } else {
+        g_raster_depth_inv_near = (w_near > 0.0f) ? 1.0f / w_near : 1.0f;
+        g_raster_depth_scale = 0.0f;
+    }
+}
+
+raster_stats_t raster_get_stats(void) {
+    raster_stats_t stats = {g_raster_pixels_tested, g_raster_pixels_written};
+    return stats;
+}
+
+// --- Per-Frame Interface ---
+void raster_clear(uint32_t* color_buffer, uint32_t color, float* depth_buffer, int width, int height) {
+    size_t pixel_count = (size_t)width * (size_t)height;
+    raster_fill_color(color_buffer, color, pixel_count, 1);
+    int compact = (g_raster_depth_format != RASTER_DEPTH_FLOAT32);
+    if (compact && !raster_reserve_compact_depth(width, height)) return;
+    if (!g_raster_lazy_depth_clear) {
+        if (compact) {
+            size_t words = (pixel_count * raster_compact_depth_bytes() + 3) / 4;
+            raster_fill_color((uint32_t*)g_raster_depth_compact, 0xFFFFFFFFu, words, 1); // All ones is the far value
+        } else {
+            raster_fill_depth(depth_buffer, FLT_MAX, pixel_count, 1);
+        }
+        return;
+    }
+    // Every tile's depth goes stale; raster_begin_frame() notices a new buffer or size itself
+    if (++g_raster_depth_epoch == 0) {
+        for (int i = 0; i < g_raster_bin_capacity; i++) g_raster_bins[i].depth_epoch = 0;
+        g_raster_depth_epoch = 1;
+    }
+}
+
+void raster_prepare_depth(int x0, int y0, int x1, int y1) {
+    if (!g_raster_lazy_depth_clear || g_raster_tiles_x == 0) return;
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 > g_raster_width) ? g_raster_width : x1;
+    y1 = (y1 > g_raster_height) ? g_raster_height : y1;
+    if (x0 >= x1 || y0 >= y1) return;
+    for (int ty = y0 / RASTER_TILE_SIZE; ty <= (y1 - 1) / RASTER_TILE_SIZE; ty++) {
+        for (int tx = x0 / RASTER_TILE_SIZE; tx <= (x1 - 1) / RASTER_TILE_SIZE; tx++) {
+            raster_prepare_depth_tile(ty * g_raster_tiles_x + tx);
+        }
+    }
+}
+
+int raster_depth_test_and_set(int x, int y, float depth) {
+    if (g_raster_lazy_depth_clear) raster_prepare_depth(x, y, x + 1, y + 1);
+    int index = y * g_raster_width + x;
+    if (g_raster_depth_format == RASTER_DEPTH_FLOAT32) {
+        if (!(depth < g_raster_depth[index])) return 0;
+        g_raster_depth[index] = depth;
+        return 1;
+    }
+    uint32_t compact = raster_compact_depth_from_w(depth);
+    if (compact >= raster_load_compact_depth(index)) return 0;
+    raster_store_compact_depth(index, compact);
+    return 1;
+}
+
+void raster_begin_frame(uint32_t* color_buffer, float* depth_buffer, int width, int height) {
+    int layout_changed = (depth_buffer != g_raster_depth || width != g_raster_width || height != g_raster_height);
+    if (g_raster_depth_format != RASTER_DEPTH_FLOAT32 && !raster_reserve_compact_depth(width, height)) {
+        g_raster_tiles_x = g_raster_tiles_y = 0;
+        return;
+    }
+    g_raster_color = color_buffer;
+    g_raster_depth = depth_buffer;
+    g_raster_width = width;
+    g_raster_height = height;
+    g_raster_tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    g_raster_tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+
+    int bin_count = g_raster_tiles_x * g_raster_tiles_y;
+    if (bin_count > g_raster_bin_capacity) {
+        raster_bin_t* new_bins = (raster_bin_t*)realloc(g_raster_bins, bin_count * sizeof(raster_bin_t));
+        if (!new_bins) {
+            g_raster_tiles_x = g_raster_tiles_y = 0;
+            return;
+        }
+        for (int i = g_raster_bin_capacity; i < bin_count; i++) {
+            new_bins[i].items = NULL;
+            new_bins[i].count = 0;
+            new_bins[i].capacity = 0;
+            new_bins[i].depth_epoch = 0;
+        }
+        g_raster_bins = new_bins;
+        g_raster_bin_capacity = bin_count;
+    }
+    for (int i = 0; i < bin_count; i++) g_raster_bins[i].count = 0;
+    if (layout_changed) {
+        for (int i = 0; i < bin_count; i++) g_raster_bins[i].depth_epoch = 0; // Tile grid moved: nothing is known to be cleared
+    }
+    g_raster_far_plane = (vec4_t){0, 0, 0, 1}; // No far plane until the caller sets one
+    g_raster_pixels_tested = 0;
+    g_raster_pixels_written = 0;
+
+    // The depth buffer was just cleared (or is lazily treated as cleared), so every block starts out empty
+    g_raster_blocks_x = (width + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+    g_raster_blocks_y = (height + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+    int block_count = g_raster_blocks_x * g_raster_blocks_y;
+    if (block_count > g_raster_block_capacity) {
+        float* new_max_depth = (float*)realloc(g_raster_block_max_depth, block_count * sizeof(float));
+        if (new_max_depth) g_raster_block_max_depth = new_max_depth;
+        uint8_t* new_dirty = (uint8_t*)realloc(g_raster_block_dirty, block_count);
+        if (new_dirty) g_raster_block_dirty = new_dirty;
+        if (!new_max_depth || !new_dirty) {
+            g_raster_tiles_x = g_raster_tiles_y = 0;
+            return;
+        }
+        g_raster_block_capacity = block_count;
+    }
+    for (int i = 0; i < block_count; i++) g_raster_block_max_depth[i] = FLT_MAX;
+    memset(g_raster_block_dirty, 0, block_count);
+
+    g_raster_triangle_count = 0;
+}
+
+static void raster_bin_add(raster_bin_t* bin, int triangle_index) {
+    if (bin->count >= bin->capacity) {
+        int new_capacity = (bin->capacity == 0) ? 64 : bin->capacity * 2;
+        int* new_items = (int*)realloc(bin->items, new_capacity * sizeof(int));
+        if (!new_items) return;
+        bin->items = new_items;
+        bin->capacity = new_capacity;
+    }
+    bin->items[bin->count++] = triangle_index;
+}
+
+// Edge functions and attribute planes from the sorted screen vertices. Returns 0 when
+// the triangle has no area.
+static int raster_setup_triangle(raster_triangle_t* tri) {
+    const vec3_t* p = tri->screen;
+    float cross = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+    if (cross == 0.0f) return 0;
+
+    for (int e = 0; e < 3; e++) {
+        // The edge from p[e] to the next vertex has the third vertex on the side where
+        // (b - a) x (q - a) has the sign of the triangle's cross product. Taking the end
+        // points top first (then left first) only flips that sign.
+        vec3_t a = p[e], b = p[(e + 1) % 3];
+        float sign = (cross > 0.0f) ? 1.0f : -1.0f;
+        if (b.y < a.y || (b.y == a.y && b.x < a.x)) {
+            vec3_t t = a; a = b; b = t;
+            sign = -sign;
+        }
+        tri->edge_ax[e] = a.x;
+        tri->edge_ay[e] = a.y;
+        tri->edge_dx[e] = sign * (b.x - a.x);
+        tri->edge_dy[e] = sign * (b.y - a.y);
+        tri->edge_slope[e] = (b.y != a.y) ? (b.x - a.x) / (b.y - a.y) : 0.0f;
+        // Ties go to left edges (inside grows with x) and top edges (horizontal, inside below)
+        tri->edge_owns_ties[e] = (tri->edge_dy[e] < 0.0f) || (tri->edge_dy[e] == 0.0f && tri->edge_dx[e] > 0.0f);
+    }
+
+    // Gradients in double: long thin triangles would otherwise lose most of their bits
+    double e1x = (double)p[1].x - p[0].x, e1y = (double)p[1].y - p[0].y;
+    double e2x = (double)p[2].x - p[0].x, e2y = (double)p[2].y - p[0].y;
+    double inv_det = 1.0 / (e1x * e2y - e2x * e1y);
+    float values[4][3] = {
+        {tri->w_inv[0], tri->w_inv[1], tri->w_inv[2]},
+        {tri->c_pw[0].x, tri->c_pw[1].x, tri->c_pw[2].x},
+        {tri->c_pw[0].y, tri->c_pw[1].y, tri->c_pw[2].y},
+        {tri->c_pw[0].z, tri->c_pw[1].z, tri->c_pw[2].z}
+    };
+    for (int a = 0; a < 4; a++) {
+        double d1 = (double)values[a][1] - values[a][0];
+        double d2 = (double)values[a][2] - values[a][0];
+        tri->attr_p0[a] = values[a][0];
+        tri->attr_dx[a] = (float)((d1 * e2y - d2 * e1y) * inv_det);
+        tri->attr_dy[a] = (float)((d2 * e1x - d1 * e2x) * inv_det);
+    }
+    tri->attr_ox = p[0].x - 0.5f;
+    tri->attr_oy = p[0].y - 0.5f;
+    return 1;
+}
+
+static void raster_add_triangle(vec4_t p0, vec4_t p1, vec4_t p2, vec3_t c0, vec3_t c1, vec3_t c2, int is_flat, uint32_t flat_color) {
+    if (p0.w <= 0 || p1.w <= 0 || p2.w <= 0) return;
+
+    // Perspective divide and screen space transform
+    float p0w_inv = 1.0f / p0.w; p0.x *= p0w_inv; p0.y *= p0w_inv; p0.z *= p0w_inv;
+    float p1w_inv = 1.0f / p1.w; p1.x *= p1w_inv; p1.y *= p1w_inv; p1.z *= p1w_inv;
+    float p2w_inv = 1.0f / p2.w; p2.x *= p2w_inv; p2.y *= p2w_inv; p2.z *= p2w_inv;
+
+    p0.x = (p0.x + 1.0f) * 0.5f * g_raster_width; p0.y = (1.0f - p0.y) * 0.5f * g_raster_height;
+    p1.x = (p1.x + 1.0f) * 0.5f * g_raster_width; p1.y = (1.0f - p1.y) * 0.5f * g_raster_height;
+    p2.x = (p2.x + 1.0f) * 0.5f * g_raster_width; p2.y = (1.0f - p2.y) * 0.5f * g_raster_height;
+
+    // Pre-calculate colors divided by w for perspective-correct interpolation
+    vec3_t c0_pw = vec3_scale(c0, p0w_inv);
+    vec3_t c1_pw = vec3_scale(c1, p1w_inv);
+    vec3_t c2_pw = vec3_scale(c2, p2w_inv);
+
+    // Sort vertices by Y
+    if (p0.y > p1.y) { vec4_t tp = p0; p0 = p1; p1 = tp; vec3_t tc = c0_pw; c0_pw = c1_pw; c1_pw = tc; float tw = p0w_inv; p0w_inv = p1w_inv; p1w_inv = tw; }
+    if (p0.y > p2.y) { vec4_t tp = p0; p0 = p2; p2 = tp; vec3_t tc = c0_pw; c0_pw = c2_pw; c2_pw = tc; float tw = p0w_inv; p0w_inv = p2w_inv; p2w_inv = tw; }
+    if (p1.y > p2.y) { vec4_t tp = p1; p1 = p2; p2 = tp; vec3_t tc = c1_pw; c1_pw = c2_pw; c2_pw = tc; float tw = p1w_inv; p1w_inv = p2w_inv; p2w_inv = tw; }
+
+    // Only rows and columns whose centers lie within the vertices' extent can be covered
+    float min_x = (p0.x < p1.x) ? p0.x : p1.x, max_x = (p0.x > p1.x) ? p0.x : p1.x;
+    min_x = (p2.x < min_x) ? p2.x : min_x;
+    max_x = (p2.x > max_x) ? p2.x : max_x;
+    if (p2.y < 0.5f || p0.y > g_raster_height - 0.5f) return;
+    if (max_x < 0.5f || min_x > g_raster_width - 0.5f) return;
+    int y_start = (p0.y < 0.5f) ? 0 : (int)ceilf(p0.y - 0.5f);
+    int y_end = (p2.y > g_raster_height - 0.5f) ? g_raster_height : (int)floorf(p2.y - 0.5f) + 1;
+    int x_start = (min_x < 0.5f) ? 0 : (int)ceilf(min_x - 0.5f);
+    int x_end = (max_x > g_raster_width - 0.5f) ? g_raster_width : (int)floorf(max_x - 0.5f) + 1;
+    // Sub-pixel rejection: no row or no column center between the extremes
+    if (y_start >= y_end || x_start >= x_end) return;
+
+    if (g_raster_triangle_count >= g_raster_triangle_capacity) {
+        int new_capacity = (g_raster_triangle_capacity == 0) ? 1024 : g_raster_triangle_capacity * 2;
+        raster_triangle_t* new_triangles = (raster_triangle_t*)realloc(g_raster_triangles, new_capacity * sizeof(raster_triangle_t));
+        if (!new_triangles) return;
+        g_raster_triangles = new_triangles;
+        g_raster_triangle_capacity = new_capacity;
+    }
+
+    int index = g_raster_triangle_count++;
+    raster_triangle_t* tri = &g_raster_triangles[index];
+    tri->screen[0] = (vec3_t){p0.x, p0.y, p0.z};
+    tri->screen[1] = (vec3_t){p1.x, p1.y, p1.z};
+    tri->screen[2] = (vec3_t){p2.x, p2.y, p2.z};
+    tri->w_inv[0] = p0w_inv; tri->w_inv[1] = p1w_inv; tri->w_inv[2] = p2w_inv;
+    tri->c_pw[0] = c0_pw; tri->c_pw[1] = c1_pw; tri->c_pw[2] = c2_pw;
+    tri->y_start = y_start;
+    tri->y_end = y_end;
+    tri->x_start = x_start;
+    tri->x_end = x_end;
+    tri->min_depth = (p0.w < p1.w) ? p0.w : p1.w;
+    tri->min_depth = (p2.w < tri->min_depth) ? p2.w : tri->min_depth;
+    if (g_raster_depth_format != RASTER_DEPTH_FLOAT32) {
+        uint32_t min_compact = raster_compact_depth_from_w(tri->min_depth);
+        tri->min_depth = (min_compact > 0) ? (float)(min_compact - 1) : 0.0f; // One step of slack for the fixed point walk
+    }
+    tri->is_small = (y_end - y_start <= RASTER_SMALL_TRIANGLE_SIZE && x_end - x_start <= RASTER_SMALL_TRIANGLE_SIZE);
+    tri->is_flat = is_flat;
+    tri->flat_color = flat_color;
+    if (!raster_setup_triangle(tri)) {
+        g_raster_triangle_count--; // No area
+        return;
+    }
+
+    int tile_x0 = x_start / RASTER_TILE_SIZE, tile_x1 = (x_end - 1) / RASTER_TILE_SIZE;
+    int tile_y0 = y_start / RASTER_TILE_SIZE, tile_y1 = (y_end - 1) / RASTER_TILE_SIZE;
+    for (int ty = tile_y0; ty <= tile_y1; ty++) {
+        for (int tx = tile_x0; tx <= tile_x1; tx++) {
+            raster_bin_add(&g_raster_bins[ty * g_raster_tiles_x + tx], index);
+        }
+    }
+}
+
+// --- Clip Stage ---
+// Outcode bits: one per plane a vertex lies outside of
+#define RASTER_CLIP_LEFT   1
+#define RASTER_CLIP_RIGHT  2
+#define RASTER_CLIP_BOTTOM 4
+#define RASTER_CLIP_TOP    8
+#define RASTER_CLIP_NEAR   16
+#define RASTER_CLIP_FAR    32
+#define RASTER_MAX_CLIP_VERTICES 9 // A triangle gains at most one vertex per clipping plane
+
+static int raster_outcode(vec4_t p, float extent) {
+    int code = 0;
+    if (p.x < -extent * p.w) code |= RASTER_CLIP_LEFT;
+    if (p.x > extent * p.w) code |= RASTER_CLIP_RIGHT;
+    if (p.y < -extent * p.w) code |= RASTER_CLIP_BOTTOM;
+    if (p.y > extent * p.w) code |= RASTER_CLIP_TOP;
+    if (p.w < RASTER_NEAR_W) code |= RASTER_CLIP_NEAR;
+    return code;
+}
+
+// Signed distance to a near or guard-band plane; inside is positive
+static float raster_plane_distance(vec4_t p, int plane) {
+    switch (plane) {
+        case RASTER_CLIP_LEFT:   return RASTER_GUARD_BAND * p.w + p.x;
+        case RASTER_CLIP_RIGHT:  return RASTER_GUARD_BAND * p.w - p.x;
+        case RASTER_CLIP_BOTTOM: return RASTER_GUARD_BAND * p.w + p.y;
+        case RASTER_CLIP_TOP:    return RASTER_GUARD_BAND * p.w - p.y;
+        default:                 return p.w - RASTER_NEAR_W;
+    }
+}
+
+// One Sutherland-Hodgman pass. Clip space is linear, so positions and colors interpolate directly.
+static int raster_clip_polygon(const raster_vertex_t* in, int count, raster_vertex_t* out, int plane) {
+    int out_count = 0;
+    for (int i = 0; i < count; i++) {
+        const raster_vertex_t* a = &in[i];
+        const raster_vertex_t* b = &in[(i + 1) % count];
+        float da = raster_plane_distance(a->position, plane);
+        float db = raster_plane_distance(b->position, plane);
+        if (da >= 0) out[out_count++] = *a;
+        if ((da >= 0) != (db >= 0)) {
+            float t = da / (da - db);
+            raster_vertex_t* v = &out[out_count++];
+            v->position.x = a->position.x + t * (b->position.x - a->position.x);
+            v->position.y = a->position.y + t * (b->position.y - a->position.y);
+            v->position.z = a->position.z + t * (b->position.z - a->position.z);
+            v->position.w = a->position.w + t * (b->position.w - a->position.w);
+            v->color = vec3_add(a->color, vec3_scale(vec3_sub(b->color, a->color), t));
+        }
+    }
+    return out_count;
+}
+
+static void raster_submit(vec4_t p0, vec4_t p1, vec4_t p2, vec3_t c0, vec3_t c1, vec3_t c2, int is_flat, uint32_t flat_color) {
+    if (g_raster_tiles_x == 0 || g_raster_tiles_y == 0) return;
+
+    // Trivial reject: every vertex outside the same viewport, near or far plane
+    vec4_t p[3] = {p0, p1, p2};
+    int view_code[3], band_code[3];
+    for (int i = 0; i < 3; i++) {
+        view_code[i] = raster_outcode(p[i], 1.0f);
+        float far_distance = g_raster_far_plane.x * p[i].x + g_raster_far_plane.y * p[i].y + g_raster_far_plane.z * p[i].z + g_raster_far_plane.w * p[i].w;
+        if (far_distance < 0) view_code[i] |= RASTER_CLIP_FAR;
+        band_code[i] = raster_outcode(p[i], RASTER_GUARD_BAND);
+    }
+    if (view_code[0] & view_code[1] & view_code[2]) return;
+
+    // Guard-band accept: the setup clamps to the screen, so only the near plane and
+    // coordinates far outside the viewport need real clipping
+    int clip_planes = band_code[0] | band_code[1] | band_code[2];
+    if (clip_planes == 0) {
+        raster_add_triangle(p0, p1, p2, c0, c1, c2, is_flat, flat_color);
+        return;
+    }
+
+    raster_vertex_t polygon[2][RASTER_MAX_CLIP_VERTICES] = {{{p0, c0}, {p1, c1}, {p2, c2}}};
+    static const int plane_order[5] = {RASTER_CLIP_NEAR, RASTER_CLIP_LEFT, RASTER_CLIP_RIGHT, RASTER_CLIP_BOTTOM, RASTER_CLIP_TOP};
+    int count = 3, current = 0;
+    for (int i = 0; i < 5 && count >= 3; i++) {
+        if (!(clip_planes & plane_order[i])) continue;
+        count = raster_clip_polygon(polygon[current], count, polygon[!current], plane_order[i]);
+        current = !current;
+    }
+    for (int i = 1; i + 1 < count; i++) {
+        const raster_vertex_t* v = polygon[current];
+        raster_add_triangle(v[0].position, v[i].position, v[i + 1].position, v[0].color, v[i].color, v[i + 1].color, is_flat, flat_color);
+    }
+}
+
+void raster_submit_gouraud(vec4_t p0, vec4_t p1, vec4_t p2, vec3_t c0, vec3_t c1, vec3_t c2) {
+    raster_submit(p0, p1, p2, c0, c1, c2, 0, 0);
+}
+
+void raster_submit_flat(vec4_t p0, vec4_t p1, vec4_t p2, uint32_t color) {
+    vec3_t no_color = {0, 0, 0};
+    raster_submit(p0, p1, p2, no_color, no_color, no_color, 1, color);
+}
+
+void raster_end_frame(void) {
+    if (g_raster_triangle_count == 0) return;
+
+    g_raster_next_tile = 0;
+    if (g_raster_worker_count > 0) {
+        g_raster_workers_busy = g_raster_worker_count;
+        platform_semaphore_post(g_raster_start_semaphore, g_raster_worker_count);
+        raster_process_tiles(0);
+        platform_semaphore_wait(g_raster_done_semaphore);
+    } else {
+        raster_process_tiles(0);
+    }
+    g_raster_triangle_count = 0;
+}
@@ -0,0 +1,83 @@
+// raster.h
+// Tile-binned triangle rasterizer shared by the editor and the player.
+
+#ifndef RASTER_H
+#define RASTER_H
+#include <stdint.h>
+#include "math3d.h"
+
+#define RASTER_TILE_SIZE 64    // Screen is split into 64x64 pixel bins
+#define RASTER_MAX_THREADS 16  // Upper bound on the worker pool size
+#define RASTER_BLOCK_SIZE 8    // Half-space walker blocks and coarse depth cells are 8x8 pixels
+#define RASTER_GUARD_BAND 4.0f // Triangles within 4x the viewport extent skip clipping
+#define RASTER_NEAR_W 0.001f   // Near clipping plane, as a minimum clip-space w
+#define RASTER_MAX_PERSPECTIVE_STEP 64 // Longest affine run between exact perspective divides
+#define RASTER_SMALL_TRIANGLE_SIZE 4   // Triangles whose pixel centers fit in 4x4 skip the walkers for a per-pixel path
+
+typedef enum {
+    RASTER_MODE_SCANLINE,  // Per-row span walker (default)
+    RASTER_MODE_HALFSPACE, // 8x8 block edge-function walker, 4 pixels per step with SSE2
+    RASTER_MODE_SBUFFER    // Per-row span buffer: hidden surfaces resolved per span, each pixel shaded once
+} raster_mode_t;
+
+typedef enum {
+    RASTER_DEPTH_FLOAT32, // Caller's float buffer holds w (default)
+    RASTER_DEPTH_UNORM24, // Rasterizer-owned 3 bytes per pixel, normalized over the near/far range
+    RASTER_DEPTH_UNORM16  // ...2 bytes per pixel
+} raster_depth_format_t;
+
+typedef struct {
+    long pixels_tested;  // Triangle pixels that reached the depth test
+    long pixels_written; // ...and the ones that passed it
+} raster_stats_t;
+
+// --- Lifetime ---
+void raster_init(int thread_count); // 0 = one thread per logical core
+void raster_shutdown(void);
+void raster_configure(const char* command_line); // Reads "-raster=scanline|halfspace|sbuffer", "-perspective=exact|8|16", "-depth=float|24|16" and "-depthclear=full|lazy"
+// The half-space walker and the span buffer only run with float depth (other formats take
+// the span walker); the span buffer always divides per pixel.
+void raster_set_mode(raster_mode_t mode);
+// Lazy depth clear: raster_clear() only marks every tile's depth stale and a tile is
+// filled with FLT_MAX the first time something draws into it. Depth of untouched tiles
+// is left as garbage, so nothing may read the depth buffer outside the rasterizer.
+void raster_set_lazy_depth_clear(int enabled);
+// Integer depth formats keep depth in a buffer the rasterizer owns; the caller's float
+// buffer is left untouched. Depth tests become integer compares done before the
+// perspective divide, and triangles always take the span walker (which ignores the
+// perspective step, since only visible pixels divide).
+void raster_set_depth_format(raster_depth_format_t format);
+raster_depth_format_t raster_get_depth_format(void);
+// Span walker only: divide for perspective every N pixels and interpolate affinely in
+// between (1 = exact, the default). The half-space walker always divides per pixel.
+void raster_set_perspective_step(int pixels);
+raster_mode_t raster_get_mode(void);
+raster_stats_t raster_get_stats(void); // Counters of the frame begun last; valid after raster_end_frame()
+
+// --- Per-Frame Interface ---
+// Triangles submitted between begin/end are binned by screen tile and rasterized
+// in parallel at raster_end_frame(). The caller must not touch the color/depth
+// buffers from begin to end except through draw_pixel style writes that happen
+// before raster_end_frame() is called (depth testing makes the order irrelevant).
+// Both buffers are cleared with raster_clear() before raster_begin_frame() (clearing
+// float depth to FLT_MAX by hand also works); the coarse per-block depth starts from
+// that state and only ever moves closer. Direct depth writes either go through
+// raster_depth_test_and_set(), or, with float depth only, write the buffer themselves
+// after calling raster_prepare_depth() on the rectangle [x0, x1) x [y0, y1) they touch.
+// Vertices are submitted in clip space, unclipped: the rasterizer rejects triangles
+// outside the frustum and clips the ones that leave the guard band or cross near.
+void raster_clear(uint32_t* color_buffer, uint32_t color, float* depth_buffer, int width, int height); // SIMD streaming fill
+void raster_begin_frame(uint32_t* color_buffer, float* depth_buffer, int width, int height);
+void raster_prepare_depth(int x0, int y0, int x1, int y1); // No-op unless the lazy depth clear is on
+// Per frame, after raster_begin_frame(): triangles past far_distance are rejected and the
+// integer depth formats span the clip w of near_distance..far_distance
+void raster_set_depth_range(mat4_t projection, float near_distance, float far_distance);
+int raster_depth_test_and_set(int x, int y, float depth); // On-screen pixel, depth in float buffer units; 1 = passed and stored
+void raster_submit_gouraud(vec4_t p0, vec4_t p1, vec4_t p2, vec3_t c0, vec3_t c1, vec3_t c2);
+void raster_submit_flat(vec4_t p0, vec4_t p1, vec4_t p2, uint32_t color);
+void raster_end_frame(void);
+
+// --- Helpers ---
+uint32_t raster_pack_color(vec3_t color); // 0..1 channels to 0x00RRGGBB, clamped; SIMD where available
+
+#endif // RASTER_H
@@ -0,0 +1,682 @@
+// render.c
+// Scene renderer: per-vertex Gouraud lighting fed through the tile rasterizer, or with
+// a visibility buffer, depth and IDs first and lighting only for what ended up visible.
+
+#include "render.h"
+#include "raster.h"
+#include "occlusion.h"
+#include "lod.h"
+#include "bake.h"
+#include "specular.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RENDER_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// --- Frame State ---
+// Set by render_scene() for the helpers below
+static const scene_t* g_render_scene = NULL;
+static render_target_t g_render_target;
+static uint32_t g_render_sky_color = 0;
+static render_stats_t g_render_stats = {0, 0, 0, 0};
+static int g_occlusion_culling_enabled = 1;
+static int g_level_of_detail_enabled = 1;
+
+static vec4_t* g_clip_coords_buffer = NULL;
+static vec3_t* g_colors_buffer = NULL;
+static int g_vertex_buffer_capacity = 0;
+
+// --- Frame Lights ---
+// Every light's world placement and spot cone, worked out once per frame instead of per vertex
+typedef struct {
+    vec3_t position;
+    vec3_t direction;  // For spotlights
+    vec3_t color;
+    float intensity;
+    light_type_t type;
+    int is_baked;      // Fixed light: baked meshes already hold its diffuse term
+    light_reach_t reach; // For culling per object
+    float cos_outer;   // Cosine of the cone's half angle; no light past it
+    float cos_inner;   // ...and of the angle where the blend to the edge starts
+} frame_light_t;
+static frame_light_t* g_frame_lights = NULL;
+static int g_frame_light_count = 0;
+static int g_frame_light_capacity = 0;
+// Indices of the lights whose reach overlaps each drawn object's bounds. Without a visibility
+// buffer only the current object's list is kept; with one, every object's list stays for the
+// resolve, at g_object_light_offset.
+static int* g_object_lights = NULL;
+static int g_object_light_total = 0;
+static int g_object_light_capacity = 0;
+
+// --- Visibility Buffer ---
+// Used when the target has an ID buffer: pass one rasterizes only depth and a packed
+// object/face ID, pass two shades every visible pixel exactly once from the mesh.
+#define VISIBILITY_FACE_BITS 20 // Low bits of an ID hold the face, the high bits object index + 1
+static vec4_t* g_frame_clip_coords = NULL;     // Clip-space vertices of every object drawn this frame
+static vec3_t* g_frame_vertex_colors = NULL;   // Lit vertex colors, filled in on first use by pass two
+static uint8_t* g_frame_vertex_lit = NULL;
+static int g_frame_vertex_count = 0;
+static int g_frame_vertex_capacity = 0;
+static int* g_object_vertex_offset = NULL;     // Start of each object's vertices in the frame arrays, -1 = not drawn
+static mat4_t* g_object_model_matrix = NULL;
+static const mesh_t** g_object_frame_mesh = NULL; // The mesh or LOD each object was drawn with
+static int* g_object_light_offset = NULL;      // Each object's light list in g_object_lights
+static int* g_object_light_count = NULL;
+static const vec3_t** g_object_frame_baked = NULL; // The baked lighting of the level drawn, if any
+static int g_object_frame_capacity = 0;
+
+// --- Function Declarations ---
+static void render_object(const scene_object_t* object, mesh_t* mesh, const vec3_t* baked_lighting, int object_index, mat4_t model_matrix, mat4_t view_matrix, mat4_t projection_matrix, vec3_t camera_pos);
+static int is_occluder(const scene_object_t* object, int object_index, int hidden_object);
+static void draw_occluders(const frustum_t* frustum, mat4_t view_projection, int hidden_object);
+static void gather_frame_lights(void);
+static int gather_object_lights(const scene_object_t* object, mat4_t model_matrix, int skip_baked);
+static vec3_t shade_vertex(const scene_object_t* object, const mesh_t* mesh, const vec3_t* baked_lighting, mat4_t model_matrix, int vertex_index, vec3_t camera_pos, const int* lights, int light_count);
+#ifdef RENDER_HAS_SSE2
+static void process_vertices_sse2(const scene_object_t* object, const mesh_t* mesh, const float* streams, const vec3_t* baked_lighting,
+                                  mat4_t model_matrix, mat4_t final_transform, vec3_t camera_pos, const int* lights, int light_count,
+                                  vec4_t* clip_coords, vec3_t* colors);
+#endif
+static int begin_visibility_frame(void);
+static vec4_t* reserve_visibility_vertices(int object_index, const mesh_t* mesh, mat4_t model_matrix);
+static void resolve_visibility_buffer(vec3_t camera_pos);
+
+// --- Scene Rendering ---
+void render_scene(const scene_t* scene, draw_order_t* draw_order, const render_camera_t* camera,
+                  const render_target_t* target, uint32_t sky_color, int hidden_object) {
+    if (!target->color) return;
+    g_render_scene = scene;
+    g_render_target = *target;
+    g_render_sky_color = sky_color;
+    g_render_stats.objects_drawn = 0;
+    g_render_stats.objects_culled = 0;
+    g_render_stats.objects_occluded = 0;
+    g_render_stats.objects_simplified = 0;
+
+    if (target->visibility && !begin_visibility_frame()) return;
+    gather_frame_lights();
+    g_object_light_total = 0;
+
+    // The visibility buffer writes every color pixel when it resolves, so only its IDs need clearing
+    uint32_t* clear_target = target->visibility ? target->visibility : target->color;
+    raster_clear(clear_target, target->visibility ? 0 : sky_color, target->depth, target->width, target->height);
+    raster_begin_frame(clear_target, target->depth, target->width, target->height);
+    raster_set_depth_range(camera->projection, camera->near_plane, camera->far_plane);
+
+    mat4_t view_projection = mat4_mul_mat4(camera->projection, camera->view);
+    frustum_t frustum = frustum_from_camera(camera->view, camera->projection, camera->far_plane);
+    if (g_occlusion_culling_enabled) {
+        draw_occluders(&frustum, view_projection, hidden_object);
+    }
+
+    // Nearest objects first, so the depth test rejects most hidden pixels early
+    draw_order_update(draw_order, scene, camera->position);
+    for (int n = 0; n < draw_order->count; n++) {
+        int i = draw_order->indices[n];
+        const scene_object_t* object = scene->objects[i];
+        if (object->is_player_spawn || i == hidden_object) continue;
+        if (object->light_properties || !object->mesh || !object->mesh->normals) continue; // Nothing to draw
+
+        mat4_t model_matrix = mat4_get_world_transform(scene, i);
+        if (!frustum_test_mesh(&frustum, object->mesh, model_matrix)) {
+            g_render_stats.objects_culled++;
+            continue;
+        }
+        // The frustum test above brought the cached box up to date
+        if (g_occlusion_culling_enabled && !occlusion_test_box(object->mesh->bounds_min, object->mesh->bounds_max, mat4_mul_mat4(view_projection, model_matrix))) {
+            g_render_stats.objects_occluded++;
+            continue;
+        }
+
+        mesh_t* mesh = object->mesh;
+        const vec3_t* baked_lighting = object->baked_lighting[0];
+        if (g_level_of_detail_enabled && object->lod_count > 0) {
+            int level = scene_object_select_lod(scene->objects[i], model_matrix, view_projection, camera->projection.m[1][1]);
+            if (level > 0 && object->lods[level - 1]->normals) {
+                mesh = object->lods[level - 1];
+                baked_lighting = object->baked_lighting[level];
+                g_render_stats.objects_simplified++;
+            }
+        }
+        render_object(object, mesh, baked_lighting, i, model_matrix, camera->view, camera->projection, camera->position);
+    }
+    raster_end_frame(); // Rasterize all binned triangles across the worker pool
+
+    if (target->visibility) {
+        resolve_visibility_buffer(camera->position);
+    }
+}
+
+void render_set_occlusion_culling(int enabled) {
+    g_occlusion_culling_enabled = enabled;
+}
+
+void render_set_level_of_detail(int enabled) {
+    g_level_of_detail_enabled = enabled;
+}
+
+render_stats_t render_get_stats(void) {
+    return g_render_stats;
+}
+
+void render_shutdown(void) {
+    occlusion_shutdown();
+    specular_cache_clear();
+    free(g_clip_coords_buffer);
+    free(g_colors_buffer);
+    free(g_frame_clip_coords);
+    free(g_frame_vertex_colors);
+    free(g_frame_vertex_lit);
+    free(g_object_vertex_offset);
+    free(g_object_model_matrix);
+    free(g_object_frame_mesh);
+    free(g_frame_lights);
+    free(g_object_lights);
+    free(g_object_light_offset);
+    free(g_object_light_count);
+    free(g_object_frame_baked);
+    g_clip_coords_buffer = NULL;
+    g_colors_buffer = NULL;
+    g_frame_clip_coords = NULL;
+    g_frame_vertex_colors = NULL;
+    g_frame_vertex_lit = NULL;
+    g_object_vertex_offset = NULL;
+    g_object_model_matrix = NULL;
+    g_object_frame_mesh = NULL;
+    g_frame_lights = NULL;
+    g_frame_light_count = 0;
+    g_object_lights = NULL;
+    g_object_light_offset = NULL;
+    g_object_light_count = NULL;
+    g_object_frame_baked = NULL;
+    g_vertex_buffer_capacity = 0;
+    g_frame_vertex_capacity = 0;
+    g_object_frame_capacity = 0;
+    g_frame_light_capacity = 0;
+    g_object_light_capacity = 0;
+}
+
+static void render_object(const scene_object_t* object, mesh_t* mesh, const vec3_t* baked_lighting, int object_index, mat4_t model_matrix, mat4_t view_matrix, mat4_t projection_matrix, vec3_t camera_pos) {
+    // --- NEW: Resize global buffers if necessary ---
+    if (mesh->vertex_count > g_vertex_buffer_capacity) {
+        g_vertex_buffer_capacity = mesh->vertex_count;
+        g_clip_coords_buffer = (vec4_t*)realloc(g_clip_coords_buffer, g_vertex_buffer_capacity * sizeof(vec4_t));
+        g_colors_buffer = (vec3_t*)realloc(g_colors_buffer, g_vertex_buffer_capacity * sizeof(vec3_t));
+        if (!g_clip_coords_buffer || !g_colors_buffer) {
+             g_vertex_buffer_capacity = 0; // Reset on failure
+             return;
+        }
+    }
+
+    mat4_t final_transform = mat4_mul_mat4(projection_matrix, mat4_mul_mat4(view_matrix, model_matrix));
+
+    // Lights that cannot reach the object's bounds are dropped before the vertex loop, and so
+    // are the baked ones when there is no specular left for them to add
+    if (!g_render_target.visibility) g_object_light_total = 0;
+    int light_offset = g_object_light_total;
+    int light_count = gather_object_lights(object, model_matrix, baked_lighting && object->material.specular_intensity <= 0.0f);
+    if (light_count < 0) return;
+    if (g_render_target.visibility) {
+        g_object_light_offset[object_index] = light_offset;
+        g_object_light_count[object_index] = light_count;
+        g_object_frame_baked[object_index] = baked_lighting;
+    }
+
+    // The visibility buffer keeps every object's clip coordinates until the frame is resolved
+    vec4_t* clip_coords = g_clip_coords_buffer;
+    uint32_t id_base = 0;
+    if (g_render_target.visibility) {
+        if (object_index + 1 >= (1 << (32 - VISIBILITY_FACE_BITS)) || mesh->face_count > (1 << VISIBILITY_FACE_BITS)) {
+            return; // IDs cannot address this object
+        }
+        clip_coords = reserve_visibility_vertices(object_index, mesh, model_matrix);
+        if (!clip_coords) return;
+        id_base = (uint32_t)(object_index + 1) << VISIBILITY_FACE_BITS;
+    }
+
+#ifdef RENDER_HAS_SSE2
+    const float* streams = mesh_vertex_streams(mesh);
+    if (streams) {
+        process_vertices_sse2(object, mesh, streams, baked_lighting, model_matrix, final_transform, camera_pos,
+                              g_object_lights + light_offset, light_count, clip_coords, g_render_target.visibility ? NULL : g_colors_buffer);
+    }
+    for (int i = streams ? mesh->vertex_count : 0; i < mesh->vertex_count; i++) {
+#else
+    for (int i = 0; i < mesh->vertex_count; i++) {
+#endif
+        // Transform vertex position to clip space
+        clip_coords[i] = mat4_mul_vec4(final_transform, (vec4_t){
+            mesh->vertices[i].x, 
+            mesh->vertices[i].y, 
+            mesh->vertices[i].z, 
+            1.0f
+        });
+
+        if (!g_render_target.visibility) {
+            g_colors_buffer[i] = shade_vertex(object, mesh, baked_lighting, model_matrix, i, camera_pos, g_object_lights + light_offset, light_count);
+        }
+    }
+
+    g_render_stats.objects_drawn++;
+
+    // --- Render faces using pre-calculated data ---
+    for (int i = 0; i < mesh->face_count; ++i) {
+        int v_indices[3] = {mesh->faces[i*3+0], mesh->faces[i*3+1], mesh->faces[i*3+2]};
+        
+        // --- Backface Culling ---
+        vec4_t v0_clip = clip_coords[v_indices[0]];
+        vec4_t v1_clip = clip_coords[v_indices[1]];
+        vec4_t v2_clip = clip_coords[v_indices[2]];
+        
+        if (v0_clip.w > 0 && v1_clip.w > 0 && v2_clip.w > 0) {
+             vec3_t v0_ndc = {v0_clip.x/v0_clip.w, v0_clip.y/v0_clip.w, v0_clip.z/v0_clip.w};
+             vec3_t v1_ndc = {v1_clip.x/v1_clip.w, v1_clip.y/v1_clip.w, v1_clip.z/v1_clip.w};
+             vec3_t v2_ndc = {v2_clip.x/v2_clip.w, v2_clip.y/v2_clip.w, v2_clip.z/v2_clip.w};
+             float signed_area_z = (v1_ndc.x - v0_ndc.x) * (v2_ndc.y - v0_ndc.y) - (v1_ndc.y - v0_ndc.y) * (v2_ndc.x - v0_ndc.x);
+             if (!object->is_double_sided && signed_area_z < 0) {
+                 continue;
+             }
+        }
+        
+        // --- Draw (the rasterizer rejects and clips against the frustum) ---
+        if (g_render_target.visibility) {
+            // Clipped pieces keep their face's ID; pass two shades from the unclipped face
+            raster_submit_flat(v0_clip, v1_clip, v2_clip, id_base | (uint32_t)i);
+            continue;
+        }
+        raster_submit_gouraud(
+            v0_clip, v1_clip, v2_clip,
+            g_colors_buffer[v_indices[0]], g_colors_buffer[v_indices[1]], g_colors_buffer[v_indices[2]]
+        );
+    }
+}
+
+// --- Occlusion Culling ---
+// Static collision geometry (walls, floors, terrain) is what hides whole rooms; it cannot
+// move, and the player model and the object hidden from this view never occlude.
+static int is_occluder(const scene_object_t* object, int object_index, int hidden_object) {
+    return object->is_static && object->has_collision && !object->light_properties && !object->is_player_spawn &&
+           !object->is_player_model && object->mesh && object->mesh->normals && object_index != hidden_object;
+}
+
+static void draw_occluders(const frustum_t* frustum, mat4_t view_projection, int hidden_object) {
+    occlusion_begin_frame(g_render_target.width, g_render_target.height);
+    for (int i = 0; i < g_render_scene->object_count; i++) {
+        const scene_object_t* object = g_render_scene->objects[i];
+        if (!is_occluder(object, i, hidden_object)) continue;
+        mat4_t model_matrix = mat4_get_world_transform(g_render_scene, i);
+        if (!frustum_test_mesh(frustum, object->mesh, model_matrix)) continue;
+        occlusion_add_mesh(object->mesh, mat4_mul_mat4(view_projection, model_matrix), object->is_double_sided);
+    }
+}
+
+// --- Per-Vertex Lighting Calculation ---
+// Lights that do not fit when the list cannot grow are left out of this frame
+static void gather_frame_lights(void) {
+    g_frame_light_count = 0;
+    for (int i = 0; i < g_render_scene->object_count; i++) {
+        const scene_object_t* obj = g_render_scene->objects[i];
+        if (!obj->light_properties) continue;
+        if (g_frame_light_count == g_frame_light_capacity) {
+            int new_capacity = (g_frame_light_capacity == 0) ? 16 : g_frame_light_capacity * 2;
+            frame_light_t* new_lights = (frame_light_t*)realloc(g_frame_lights, new_capacity * sizeof(frame_light_t));
+            if (!new_lights) return;
+            g_frame_lights = new_lights;
+            g_frame_light_capacity = new_capacity;
+        }
+        frame_light_t* light = &g_frame_lights[g_frame_light_count++];
+        const light_t* properties = obj->light_properties;
+        mat4_t light_transform = mat4_get_world_transform(g_render_scene, i);
+        light->position = (vec3_t){light_transform.m[0][3], light_transform.m[1][3], light_transform.m[2][3]};
+        light->color = properties->color;
+        light->intensity = properties->intensity;
+        light->type = properties->type;
+        light->is_baked = scene_object_is_fixed(g_render_scene, i);
+        if (properties->type == LIGHT_TYPE_SPOT) {
+            mat4_t rot_matrix = mat4_mul_mat4(mat4_rotation_z(obj->rotation.z), mat4_mul_mat4(mat4_rotation_y(obj->rotation.y), mat4_rotation_x(obj->rotation.x)));
+            vec4_t local_dir = {0, 0, -1, 0};
+            vec4_t world_dir4 = mat4_mul_vec4(rot_matrix, local_dir);
+            light->direction = vec3_normalize((vec3_t){world_dir4.x, world_dir4.y, world_dir4.z});
+            light->cos_outer = cosf(properties->spot_angle / 2.0f);
+            light->cos_inner = cosf((properties->spot_angle / 2.0f) * (1.0f - properties->spot_blend));
+        }
+        light->reach = light_reach(properties, light->position, light->direction);
+    }
+}
+
+// Appends the object's lights to g_object_lights; returns how many, or -1 if the list cannot grow
+static int gather_object_lights(const scene_object_t* object, mat4_t model_matrix, int skip_baked) {
+    if (g_object_light_total + g_frame_light_count > g_object_light_capacity) {
+        int new_capacity = (g_object_light_capacity == 0) ? 256 : g_object_light_capacity * 2;
+        while (new_capacity < g_object_light_total + g_frame_light_count) new_capacity *= 2;
+        int* new_lights = (int*)realloc(g_object_lights, new_capacity * sizeof(int));
+        if (!new_lights) return -1;
+        g_object_lights = new_lights;
+        g_object_light_capacity = new_capacity;
+    }
+    vec3_t center;
+    float radius;
+    mesh_world_sphere(object->mesh, model_matrix, &center, &radius); // The LODs lie inside the full mesh's bounds
+    int count = 0;
+    for (int l = 0; l < g_frame_light_count; l++) {
+        if (skip_baked && g_frame_lights[l].is_baked) continue;
+        if (light_reaches_sphere(&g_frame_lights[l].reach, center, radius)) {
+            g_object_lights[g_object_light_total + count++] = l;
+        }
+    }
+    g_object_light_total += count;
+    return count;
+}
+
+// With baked lighting the fixed lights' diffuse is already in it and they only add specular
+static vec3_t shade_vertex(const scene_object_t* object, const mesh_t* mesh, const vec3_t* baked_lighting, mat4_t model_matrix, int vertex_index, vec3_t camera_pos, const int* lights, int light_count) {
+    vec4_t v_world_4 = mat4_mul_vec4(model_matrix, (vec4_t){mesh->vertices[vertex_index].x, mesh->vertices[vertex_index].y, mesh->vertices[vertex_index].z, 1.0f});
+    vec3_t v_world = {v_world_4.x, v_world_4.y, v_world_4.z};
+    
+    vec4_t n_world_4 = mat4_mul_vec4(model_matrix, (vec4_t){mesh->normals[vertex_index].x, mesh->normals[vertex_index].y, mesh->normals[vertex_index].z, 0.0f});
+    vec3_t n_world = vec3_normalize((vec3_t){n_world_4.x, n_world_4.y, n_world_4.z});
+    
+    vec3_t diffuse_sum = baked_lighting ? baked_lighting[vertex_index] : (vec3_t){0.1f, 0.1f, 0.1f}; // Ambient term
+    vec3_t specular_sum = {0,0,0};
+    vec3_t view_dir = vec3_normalize(vec3_sub(camera_pos, v_world));
+    const float* specular_table = (object->material.specular_intensity > 0.0f) ? specular_table_get(object->material.shininess) : NULL;
+
+    for (int l = 0; l < light_count; l++) {
+        const frame_light_t* light = &g_frame_lights[lights[l]];
+        vec3_t to_light = vec3_sub(light->position, v_world);
+        float dist_sq = vec3_dot(to_light, to_light);
+        if(dist_sq < 1e-6) dist_sq = 1e-6;
+        vec3_t light_dir = vec3_normalize(to_light);
+        float attenuation = light->intensity / dist_sq;
+        
+        float diff_intensity = fmax(vec3_dot(n_world, light_dir), 0.0f);
+        
+        if (light->type == LIGHT_TYPE_SPOT) {
+            float theta = vec3_dot(light_dir, vec3_scale(light->direction, -1.0f));
+            if (theta > light->cos_outer) {
+                 float spot_effect = (theta - light->cos_outer) / (light->cos_inner - light->cos_outer);
+                 spot_effect = (spot_effect < 0.0f) ? 0.0f : (spot_effect > 1.0f) ? 1.0f : spot_effect;
+                 attenuation *= spot_effect;
+            } else {
+                attenuation = 0;
+            }
+        }
+
+        if (attenuation > 0) {
+            if (!baked_lighting || !light->is_baked) {
+                diffuse_sum = vec3_add(diffuse_sum, vec3_scale(light->color, diff_intensity * attenuation));
+            }
+            
+            if(diff_intensity > 0.0f && object->material.specular_intensity > 0.0f) {
+                vec3_t reflect_dir = vec3_sub(vec3_scale(n_world, 2.0f * vec3_dot(n_world, light_dir)), light_dir);
+                float spec_angle = fmax(vec3_dot(view_dir, reflect_dir), 0.0f);
+                float specular_term = specular_table ? specular_lookup(specular_table, spec_angle) : powf(spec_angle, object->material.shininess);
+                specular_sum = vec3_add(specular_sum, vec3_scale(light->color, specular_term * object->material.specular_intensity * attenuation));
+            }
+        }
+    }
+    vec3_t color;
+    color.x = object->material.diffuse_color.x * diffuse_sum.x + specular_sum.x;
+    color.y = object->material.diffuse_color.y * diffuse_sum.y + specular_sum.y;
+    color.z = object->material.diffuse_color.z * diffuse_sum.z + specular_sum.z;
+    return color;
+}
+
+#ifdef RENDER_HAS_SSE2
+// --- SIMD Vertex Stage ---
+// Four vertices per step from the mesh's SoA streams: the clip transform, and when colors is
+// not NULL the lighting of shade_vertex(), with the same operations in the same order so
+// both produce the same bits. Only the specular lookup is still done one lane at a time.
+#define RENDER_SSE2_SELECT(mask, a, b) _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+
+// Divides by the length where it is not 0, like vec3_normalize()
+static void normalize_sse2(__m128* x, __m128* y, __m128* z) {
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(*x, *x), _mm_mul_ps(*y, *y)), _mm_mul_ps(*z, *z)));
+    __m128 nonzero = _mm_cmpneq_ps(length, _mm_setzero_ps());
+    *x = RENDER_SSE2_SELECT(nonzero, _mm_div_ps(*x, length), *x);
+    *y = RENDER_SSE2_SELECT(nonzero, _mm_div_ps(*y, length), *y);
+    *z = RENDER_SSE2_SELECT(nonzero, _mm_div_ps(*z, length), *z);
+}
+
+// One row of mat4_mul_vec4() for four vectors with the given w
+static __m128 transform_row_sse2(const float* row, __m128 x, __m128 y, __m128 z, float w) {
+    __m128 sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(row[0]), x), _mm_mul_ps(_mm_set1_ps(row[1]), y));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[2]), z));
+    return _mm_add_ps(sum, _mm_set1_ps(row[3] * w));
+}
+
+static void process_vertices_sse2(const scene_object_t* object, const mesh_t* mesh, const float* streams, const vec3_t* baked_lighting,
+                                  mat4_t model_matrix, mat4_t final_transform, vec3_t camera_pos, const int* lights, int light_count,
+                                  vec4_t* clip_coords, vec3_t* colors) {
+    int stride = mesh_stream_stride(mesh);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const float specular_intensity = object->material.specular_intensity;
+    const float shininess = object->material.shininess;
+    const float* specular_table = (specular_intensity > 0.0f) ? specular_table_get(shininess) : NULL;
+
+    for (int i = 0; i < mesh->vertex_count; i += 4) {
+        int lanes = (mesh->vertex_count - i < 4) ? mesh->vertex_count - i : 4;
+        __m128 x = _mm_loadu_ps(streams + i);
+        __m128 y = _mm_loadu_ps(streams + stride + i);
+        __m128 z = _mm_loadu_ps(streams + 2 * stride + i);
+
+        // Clip space: four rows out, transposed into four vec4_t for the rasterizer
+        __m128 clip[4];
+        for (int r = 0; r < 4; r++) clip[r] = transform_row_sse2(final_transform.m[r], x, y, z, 1.0f);
+        _MM_TRANSPOSE4_PS(clip[0], clip[1], clip[2], clip[3]);
+        if (lanes == 4) {
+            for (int k = 0; k < 4; k++) _mm_storeu_ps(&clip_coords[i + k].x, clip[k]);
+        } else {
+            float tail[4];
+            for (int k = 0; k < lanes; k++) {
+                _mm_storeu_ps(tail, clip[k]);
+                clip_coords[i + k] = (vec4_t){tail[0], tail[1], tail[2], tail[3]};
+            }
+        }
+        if (!colors) continue;
+
+        __m128 world_x = transform_row_sse2(model_matrix.m[0], x, y, z, 1.0f);
+        __m128 world_y = transform_row_sse2(model_matrix.m[1], x, y, z, 1.0f);
+        __m128 world_z = transform_row_sse2(model_matrix.m[2], x, y, z, 1.0f);
+        __m128 nx = _mm_loadu_ps(streams + 3 * stride + i);
+        __m128 ny = _mm_loadu_ps(streams + 4 * stride + i);
+        __m128 nz = _mm_loadu_ps(streams + 5 * stride + i);
+        __m128 normal_x = transform_row_sse2(model_matrix.m[0], nx, ny, nz, 0.0f);
+        __m128 normal_y = transform_row_sse2(model_matrix.m[1], nx, ny, nz, 0.0f);
+        __m128 normal_z = transform_row_sse2(model_matrix.m[2], nx, ny, nz, 0.0f);
+        normalize_sse2(&normal_x, &normal_y, &normal_z);
+
+        __m128 diffuse_r, diffuse_g, diffuse_b;
+        if (baked_lighting) {
+            float baked[3][4] = {{0}};
+            for (int k = 0; k < lanes; k++) {
+                baked[0][k] = baked_lighting[i + k].x;
+                baked[1][k] = baked_lighting[i + k].y;
+                baked[2][k] = baked_lighting[i + k].z;
+            }
+            diffuse_r = _mm_loadu_ps(baked[0]);
+            diffuse_g = _mm_loadu_ps(baked[1]);
+            diffuse_b = _mm_loadu_ps(baked[2]);
+        } else {
+            diffuse_r = diffuse_g = diffuse_b = _mm_set1_ps(0.1f); // Ambient term
+        }
+        __m128 specular_r = zero, specular_g = zero, specular_b = zero;
+        __m128 view_x = _mm_sub_ps(_mm_set1_ps(camera_pos.x), world_x);
+        __m128 view_y = _mm_sub_ps(_mm_set1_ps(camera_pos.y), world_y);
+        __m128 view_z = _mm_sub_ps(_mm_set1_ps(camera_pos.z), world_z);
+        normalize_sse2(&view_x, &view_y, &view_z);
+
+        for (int l = 0; l < light_count; l++) {
+            const frame_light_t* light = &g_frame_lights[lights[l]];
+            __m128 to_x = _mm_sub_ps(_mm_set1_ps(light->position.x), world_x);
+            __m128 to_y = _mm_sub_ps(_mm_set1_ps(light->position.y), world_y);
+            __m128 to_z = _mm_sub_ps(_mm_set1_ps(light->position.z), world_z);
+            __m128 dist_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(to_x, to_x), _mm_mul_ps(to_y, to_y)), _mm_mul_ps(to_z, to_z));
+            dist_sq = _mm_max_ps(dist_sq, _mm_set1_ps(1e-6f));
+            normalize_sse2(&to_x, &to_y, &to_z); // Now the light direction
+            __m128 attenuation = _mm_div_ps(_mm_set1_ps(light->intensity), dist_sq);
+            __m128 n_dot_l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x, to_x), _mm_mul_ps(normal_y, to_y)), _mm_mul_ps(normal_z, to_z));
+            __m128 diff_intensity = _mm_max_ps(n_dot_l, zero);
+
+            if (light->type == LIGHT_TYPE_SPOT) {
+                __m128 theta = _mm_add_ps(_mm_add_ps(_mm_mul_ps(to_x, _mm_set1_ps(-light->direction.x)), _mm_mul_ps(to_y, _mm_set1_ps(-light->direction.y))),
+                                          _mm_mul_ps(to_z, _mm_set1_ps(-light->direction.z)));
+                __m128 cos_outer = _mm_set1_ps(light->cos_outer);
+                __m128 spot_effect = _mm_div_ps(_mm_sub_ps(theta, cos_outer), _mm_set1_ps(light->cos_inner - light->cos_outer));
+                spot_effect = _mm_min_ps(_mm_max_ps(spot_effect, zero), one);
+                attenuation = RENDER_SSE2_SELECT(_mm_cmpgt_ps(theta, cos_outer), _mm_mul_ps(attenuation, spot_effect), zero);
+            }
+
+            __m128 lit = _mm_cmpgt_ps(attenuation, zero);
+            int lit_lanes = _mm_movemask_ps(lit);
+            if (!lit_lanes) continue;
+            if (!baked_lighting || !light->is_baked) {
+                __m128 scale = _mm_mul_ps(diff_intensity, attenuation);
+                diffuse_r = RENDER_SSE2_SELECT(lit, _mm_add_ps(diffuse_r, _mm_mul_ps(_mm_set1_ps(light->color.x), scale)), diffuse_r);
+                diffuse_g = RENDER_SSE2_SELECT(lit, _mm_add_ps(diffuse_g, _mm_mul_ps(_mm_set1_ps(light->color.y), scale)), diffuse_g);
+                diffuse_b = RENDER_SSE2_SELECT(lit, _mm_add_ps(diffuse_b, _mm_mul_ps(_mm_set1_ps(light->color.z), scale)), diffuse_b);
+            }
+
+            int shiny_lanes = lit_lanes & _mm_movemask_ps(_mm_cmpgt_ps(diff_intensity, zero));
+            if (shiny_lanes && specular_intensity > 0.0f) {
+                __m128 twice_n_dot_l = _mm_mul_ps(_mm_set1_ps(2.0f), n_dot_l);
+                __m128 reflect_x = _mm_sub_ps(_mm_mul_ps(normal_x, twice_n_dot_l), to_x);
+                __m128 reflect_y = _mm_sub_ps(_mm_mul_ps(normal_y, twice_n_dot_l), to_y);
+                __m128 reflect_z = _mm_sub_ps(_mm_mul_ps(normal_z, twice_n_dot_l), to_z);
+                __m128 spec_angle = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(view_x, reflect_x), _mm_mul_ps(view_y, reflect_y)), _mm_mul_ps(view_z, reflect_z)), zero);
+                float angles[4], scales[4], weights[4] = {0, 0, 0, 0};
+                _mm_storeu_ps(angles, spec_angle);
+                _mm_storeu_ps(scales, attenuation);
+                for (int k = 0; k < 4; k++) {
+                    if (!(shiny_lanes & (1 << k))) continue;
+                    float specular_term = specular_table ? specular_lookup(specular_table, angles[k]) : powf(angles[k], shininess);
+                    weights[k] = specular_term * specular_intensity * scales[k];
+                }
+                __m128 weight = _mm_loadu_ps(weights);
+                __m128 shiny = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(_mm_set1_epi32(shiny_lanes), _mm_setr_epi32(1, 2, 4, 8)), _mm_setzero_si128()));
+                specular_r = RENDER_SSE2_SELECT(shiny, _mm_add_ps(specular_r, _mm_mul_ps(_mm_set1_ps(light->color.x), weight)), specular_r);
+                specular_g = RENDER_SSE2_SELECT(shiny, _mm_add_ps(specular_g, _mm_mul_ps(_mm_set1_ps(light->color.y), weight)), specular_g);
+                specular_b = RENDER_SSE2_SELECT(shiny, _mm_add_ps(specular_b, _mm_mul_ps(_mm_set1_ps(light->color.z), weight)), specular_b);
+            }
+        }
+
+        float r[4], g[4], b[4];
+        _mm_storeu_ps(r, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(object->material.diffuse_color.x), diffuse_r), specular_r));
+        _mm_storeu_ps(g, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(object->material.diffuse_color.y), diffuse_g), specular_g));
+        _mm_storeu_ps(b, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(object->material.diffuse_color.z), diffuse_b), specular_b));
+        for (int k = 0; k < lanes; k++) colors[i + k] = (vec3_t){r[k], g[k], b[k]};
+    }
+}
+#endif
+
+// --- Visibility Buffer ---
+// Resets the per-frame vertex arrays. Returns 0 if the object tables could not grow.
+static int begin_visibility_frame(void) {
+    if (g_render_scene->object_count > g_object_frame_capacity) {
+        int* new_offsets = (int*)realloc(g_object_vertex_offset, g_render_scene->object_count * sizeof(int));
+        if (new_offsets) g_object_vertex_offset = new_offsets;
+        mat4_t* new_matrices = (mat4_t*)realloc(g_object_model_matrix, g_render_scene->object_count * sizeof(mat4_t));
+        if (new_matrices) g_object_model_matrix = new_matrices;
+        const mesh_t** new_meshes = (const mesh_t**)realloc(g_object_frame_mesh, g_render_scene->object_count * sizeof(const mesh_t*));
+        if (new_meshes) g_object_frame_mesh = new_meshes;
+        int* new_light_offsets = (int*)realloc(g_object_light_offset, g_render_scene->object_count * sizeof(int));
+        if (new_light_offsets) g_object_light_offset = new_light_offsets;
+        int* new_light_counts = (int*)realloc(g_object_light_count, g_render_scene->object_count * sizeof(int));
+        if (new_light_counts) g_object_light_count = new_light_counts;
+        const vec3_t** new_baked = (const vec3_t**)realloc(g_object_frame_baked, g_render_scene->object_count * sizeof(const vec3_t*));
+        if (new_baked) g_object_frame_baked = new_baked;
+        if (!new_offsets || !new_matrices || !new_meshes || !new_light_offsets || !new_light_counts || !new_baked) return 0;
+        g_object_frame_capacity = g_render_scene->object_count;
+    }
+    for (int i = 0; i < g_render_scene->object_count; i++) g_object_vertex_offset[i] = -1;
+    g_frame_vertex_count = 0;
+    return 1;
+}
+
+static vec4_t* reserve_visibility_vertices(int object_index, const mesh_t* mesh, mat4_t model_matrix) {
+    int vertex_count = mesh->vertex_count;
+    if (g_frame_vertex_count + vertex_count > g_frame_vertex_capacity) {
+        int new_capacity = (g_frame_vertex_capacity == 0) ? 4096 : g_frame_vertex_capacity * 2;
+        while (new_capacity < g_frame_vertex_count + vertex_count) new_capacity *= 2;
+        vec4_t* new_clip = (vec4_t*)realloc(g_frame_clip_coords, new_capacity * sizeof(vec4_t));
+        if (new_clip) g_frame_clip_coords = new_clip;
+        vec3_t* new_colors = (vec3_t*)realloc(g_frame_vertex_colors, new_capacity * sizeof(vec3_t));
+        if (new_colors) g_frame_vertex_colors = new_colors;
+        uint8_t* new_lit = (uint8_t*)realloc(g_frame_vertex_lit, new_capacity);
+        if (new_lit) g_frame_vertex_lit = new_lit;
+        if (!new_clip || !new_colors || !new_lit) return NULL;
+        g_frame_vertex_capacity = new_capacity;
+    }
+    int offset = g_frame_vertex_count;
+    g_frame_vertex_count += vertex_count;
+    memset(g_frame_vertex_lit + offset, 0, vertex_count);
+    g_object_vertex_offset[object_index] = offset;
+    g_object_model_matrix[object_index] = model_matrix;
+    g_object_frame_mesh[object_index] = mesh;
+    return g_frame_clip_coords + offset;
+}
+
+// Pass two: one color per screen pixel. Vertices are lit the first time a visible
+// pixel needs them, so hidden and back-facing geometry is never shaded.
+static void resolve_visibility_buffer(vec3_t camera_pos) {
+    uint32_t* pixel = g_render_target.color;
+    const uint32_t* id = g_render_target.visibility;
+    float ndc_step_x = 2.0f / (float)g_render_target.width;
+    float ndc_step_y = 2.0f / (float)g_render_target.height;
+
+    for (int y = 0; y < g_render_target.height; y++) {
+        float ndc_y = 1.0f - ((float)y + 0.5f) * ndc_step_y; // Pixel centers, where the rasterizer samples
+        for (int x = 0; x < g_render_target.width; x++, pixel++, id++) {
+            if (*id == 0) {
+                *pixel = g_render_sky_color;
+                continue;
+            }
+            int object_index = (int)(*id >> VISIBILITY_FACE_BITS) - 1;
+            int face = (int)(*id & ((1u << VISIBILITY_FACE_BITS) - 1));
+            scene_object_t* object = g_render_scene->objects[object_index];
+            const mesh_t* mesh = g_object_frame_mesh[object_index];
+            int base = g_object_vertex_offset[object_index];
+
+            vec4_t v[3];
+            vec3_t c[3];
+            for (int k = 0; k < 3; k++) {
+                int vertex_index = mesh->faces[face * 3 + k];
+                int slot = base + vertex_index;
+                if (!g_frame_vertex_lit[slot]) {
+                    g_frame_vertex_colors[slot] = shade_vertex(object, mesh, g_object_frame_baked[object_index], g_object_model_matrix[object_index], vertex_index, camera_pos,
+                                                               g_object_lights + g_object_light_offset[object_index], g_object_light_count[object_index]);
+                    g_frame_vertex_lit[slot] = 1;
+                }
+                v[k] = g_frame_clip_coords[slot];
+                c[k] = g_frame_vertex_colors[slot];
+            }
+
+            // Perspective-correct barycentrics straight from clip space: the pixel's ray is
+            // where x - ndc_x * w and y - ndc_y * w both vanish, which also holds for
+            // vertices that were behind the near plane before clipping.
+            float ndc_x = ((float)x + 0.5f) * ndc_step_x - 1.0f;
+            float ax[3], ay[3];
+            for (int k = 0; k < 3; k++) {
+                ax[k] = v[k].x - ndc_x * v[k].w;
+                ay[k] = v[k].y - ndc_y * v[k].w;
+            }
+            float b0 = ax[1] * ay[2] - ay[1] * ax[2];
+            float b1 = ax[2] * ay[0] - ay[2] * ax[0];
+            float b2 = ax[0] * ay[1] - ay[0] * ax[1];
+            float sum = b0 + b1 + b2;
+            vec3_t color = c[0];
+            if (fabsf(sum) > 1e-12f) {
+                float inv_sum = 1.0f / sum;
+                color = vec3_add(vec3_add(vec3_scale(c[0], b0 * inv_sum), vec3_scale(c[1], b1 * inv_sum)), vec3_scale(c[2], b2 * inv_sum));
+            }
+
+            *pixel = raster_pack_color(color);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+// render.h
+// Scene renderer shared by the player and the headless tools: transforms and lights
+// every mesh of a scene and feeds the rasterizer. It draws into plain memory and knows
+// nothing about windows; presenting the result is up to the caller.
+
+#ifndef RENDER_H
+#define RENDER_H
+#include <stdint.h>
+#include "math3d.h"
+
+typedef struct {
+    uint32_t* color;      // width * height pixels, 0x00RRGGBB, top row first
+    float* depth;         // width * height
+    uint32_t* visibility; // NULL to light vertices up front; otherwise width * height IDs for the two-pass visibility buffer
+    int width, height;
+} render_target_t;
+
+typedef struct {
+    vec3_t position;
+    mat4_t view;
+    mat4_t projection;
+    float near_plane, far_plane; // The projection's; triangles past far_plane are rejected
+} render_camera_t;
+
+typedef struct {
+    int objects_drawn;    // Meshes whose vertices were transformed and submitted
+    int objects_culled;   // Meshes skipped because their bounds were outside the view frustum
+    int objects_occluded; // ...or hidden behind occluders
+    int objects_simplified; // Drawn meshes that used one of their coarser LODs
+} render_stats_t;
+
+// Clears the target to sky_color and draws every mesh except player spawns and
+// hidden_object (-1 for none), nearest first by the order kept in draw_order. Meshes whose
+// cached bounds are outside the view frustum are skipped before any per-vertex work.
+// A light only shades meshes whose bounding sphere is within its influence radius (see
+// light_influence_radius()) and, for spotlights, touches its cone.
+void render_scene(const scene_t* scene, draw_order_t* draw_order, const render_camera_t* camera,
+                  const render_target_t* target, uint32_t sky_color, int hidden_object);
+// Occlusion culling (on by default): static has_collision meshes are first drawn into a
+// low-resolution depth buffer, and every mesh whose box is hidden behind them is skipped
+// before any per-vertex work. See occlusion.h.
+void render_set_occlusion_culling(int enabled);
+// Level of detail (on by default): objects with LOD meshes draw the level their projected
+// size calls for (see lod.h); off draws every object's full mesh.
+void render_set_level_of_detail(int enabled);
+render_stats_t render_get_stats(void); // Counts of the last render_scene()
+void render_shutdown(void); // Frees the scratch buffers kept between frames
+
+#endif // RENDER_H
@@ -0,0 +1,374 @@
+//gcc -O2 render_cli.c scene.c render.c occlusion.c lod.c bake.c specular.c math3d.c raster.c platform_headless.c -o render_cli -lpthread -lm
+// render_cli.c
+// Offline scene renderer: loads a .scene with the player's loader, renders it along a
+// scripted camera path with no window, and writes PPM frames and per-frame timings.
+// Meant for reproducible performance runs and image-diff regression tests.
+//
+//   render_cli <file.scene> [options] [rasterizer flags]
+//     -path=<file>     Camera path, one key per line: "time  eye_x eye_y eye_z  target_x target_y target_z"
+//                      ('#' starts a comment). Without it the camera orbits the scene.
+//     -frames=<n>      Frames of the default orbit (120)
+//     -fps=<n>         Path sampling rate in frames per second (30)
+//     -size=<w>x<h>    Render size (800x600)
+//     -fov=<degrees>   Vertical field of view (90, the player's default)
+//     -out=<prefix>    Write <prefix>_0000.ppm, ... (no images without it)
+//     -csv=<file>      Write per-frame timings
+//     -warmup=<n>      Untimed frames rendered before the first timed one (2)
+//     -threads=<n>     Rasterizer threads, 0 = one per logical core (0)
+//     -visbuffer       Two-pass visibility buffer, as in the player
+//     -occlusion=off   Draw every object without testing it against the occluder buffer
+//     -lod=off         Draw every object's full mesh, ignoring its LOD meshes
+//   Rasterizer flags are the same as the player's: -raster=, -perspective=, -depth=, -depthclear=
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "math3d.h"
+#include "raster.h"
+#include "scene.h"
+#include "render.h"
+#include "platform.h"
+
+#define NEAR_PLANE 0.1f
+#define FAR_PLANE 100.0f
+
+typedef struct {
+    float time;
+    vec3_t eye;
+    vec3_t target;
+} camera_key_t;
+
+typedef struct {
+    camera_key_t* keys;
+    int count;
+    int capacity;
+} camera_path_t;
+
+typedef struct {
+    double render_ms;
+    long pixels_tested;
+    long pixels_written;
+    int objects_drawn;
+    int objects_culled;
+    int objects_occluded;
+    int objects_simplified;
+} frame_timing_t;
+
+// --- Function Declarations ---
+const char* find_option(int argc, char** argv, const char* name);
+int camera_path_add(camera_path_t* path, float time, vec3_t eye, vec3_t target);
+int camera_path_load(camera_path_t* path, const char* filename);
+int camera_path_orbit(camera_path_t* path, const scene_t* scene, int frames, float fps);
+void camera_path_sample(const camera_path_t* path, float time, vec3_t* eye, vec3_t* target);
+int write_ppm(const char* filename, const uint32_t* pixels, int width, int height);
+int compare_doubles(const void* a, const void* b);
+
+// --- Options ---
+// Value of "-name=value" (name passed with its '='), or the argument itself for a bare flag
+const char* find_option(int argc, char** argv, const char* name) {
+    size_t length = strlen(name);
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], name, length) == 0) return argv[i] + length;
+    }
+    return NULL;
+}
+
+// --- Camera Path ---
+int camera_path_add(camera_path_t* path, float time, vec3_t eye, vec3_t target) {
+    if (path->count >= path->capacity) {
+        int new_capacity = (path->capacity == 0) ? 16 : path->capacity * 2;
+        camera_key_t* new_keys = (camera_key_t*)realloc(path->keys, new_capacity * sizeof(camera_key_t));
+        if (!new_keys) return 0;
+        path->keys = new_keys;
+        path->capacity = new_capacity;
+    }
+    camera_key_t* key = &path->keys[path->count++];
+    key->time = time;
+    key->eye = eye;
+    key->target = target;
+    return 1;
+}
+
+int camera_path_load(camera_path_t* path, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) return 0;
+
+    char line[512];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        float t;
+        vec3_t eye, target;
+        int fields = sscanf(line, "%f %f %f %f %f %f %f", &t, &eye.x, &eye.y, &eye.z, &target.x, &target.y, &target.z);
+        if (fields <= 0) continue; // Blank or comment-only line
+        if (fields != 7) {
+            fprintf(stderr, "%s:%d: expected 7 numbers, got %d\n", filename, line_number, fields);
+            fclose(file);
+            return 0;
+        }
+        if (path->count > 0 && t < path->keys[path->count - 1].time) {
+            fprintf(stderr, "%s:%d: key times must not decrease\n", filename, line_number);
+            fclose(file);
+            return 0;
+        }
+        if (!camera_path_add(path, t, eye, target)) {
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    return path->count > 0;
+}
+
+// One turn around the world-space bounds of every mesh, slightly above them
+int camera_path_orbit(camera_path_t* path, const scene_t* scene, int frames, float fps) {
+    vec3_t min_v = {0, 0, 0}, max_v = {0, 0, 0};
+    int found = 0;
+    for (int i = 0; i < scene->object_count; i++) {
+        const mesh_t* mesh = scene->objects[i]->mesh;
+        if (!mesh || scene->objects[i]->is_player_spawn) continue;
+        mat4_t world = mat4_get_world_transform(scene, i);
+        for (int v = 0; v < mesh->vertex_count; v++) {
+            vec4_t p = mat4_mul_vec4(world, (vec4_t){mesh->vertices[v].x, mesh->vertices[v].y, mesh->vertices[v].z, 1.0f});
+            if (!found) {
+                min_v = max_v = (vec3_t){p.x, p.y, p.z};
+                found = 1;
+            }
+            min_v.x = (p.x < min_v.x) ? p.x : min_v.x;
+            max_v.x = (p.x > max_v.x) ? p.x : max_v.x;
+            min_v.y = (p.y < min_v.y) ? p.y : min_v.y;
+            max_v.y = (p.y > max_v.y) ? p.y : max_v.y;
+            min_v.z = (p.z < min_v.z) ? p.z : min_v.z;
+            max_v.z = (p.z > max_v.z) ? p.z : max_v.z;
+        }
+    }
+
+    vec3_t center = vec3_scale(vec3_add(min_v, max_v), 0.5f);
+    float radius = vec3_length(vec3_sub(max_v, center));
+    if (radius < 1.0f) radius = 1.0f;
+    float distance = radius * 1.5f;
+    if (distance > FAR_PLANE * 0.5f) distance = FAR_PLANE * 0.5f; // Keep the far side of the scene inside the far plane
+
+    // One key per frame, each sampled exactly, so the last frame stops a step short of
+    // the first instead of repeating it
+    for (int i = 0; i < frames; i++) {
+        float angle = 2.0f * 3.14159265f * (float)i / (float)frames;
+        vec3_t eye = {center.x + distance * cosf(angle), center.y + distance * sinf(angle), center.z + radius * 0.5f};
+        if (!camera_path_add(path, (float)i / fps, eye, center)) return 0;
+    }
+    return 1;
+}
+
+// Linear between keys, clamped to the ends
+void camera_path_sample(const camera_path_t* path, float time, vec3_t* eye, vec3_t* target) {
+    int next = 0;
+    while (next < path->count && path->keys[next].time <= time) next++;
+    if (next == 0 || next == path->count) {
+        const camera_key_t* key = &path->keys[(next == 0) ? 0 : path->count - 1];
+        *eye = key->eye;
+        *target = key->target;
+        return;
+    }
+    const camera_key_t* a = &path->keys[next - 1];
+    const camera_key_t* b = &path->keys[next];
+    float span = b->time - a->time;
+    float t = (span > 0.0f) ? (time - a->time) / span : 1.0f;
+    *eye = vec3_add(a->eye, vec3_scale(vec3_sub(b->eye, a->eye), t));
+    *target = vec3_add(a->target, vec3_scale(vec3_sub(b->target, a->target), t));
+}
+
+// --- Output ---
+int write_ppm(const char* filename, const uint32_t* pixels, int width, int height) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) return 0;
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    uint8_t* row = (uint8_t*)malloc((size_t)width * 3);
+    if (!row) {
+        fclose(file);
+        return 0;
+    }
+    for (int y = 0; y < height; y++) {
+        const uint32_t* src = pixels + (size_t)y * width;
+        for (int x = 0; x < width; x++) {
+            row[x * 3 + 0] = (uint8_t)(src[x] >> 16);
+            row[x * 3 + 1] = (uint8_t)(src[x] >> 8);
+            row[x * 3 + 2] = (uint8_t)src[x];
+        }
+        fwrite(row, 3, width, file);
+    }
+    free(row);
+    return fclose(file) == 0;
+}
+
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// --- Main Entry Point ---
+int main(int argc, char** argv) {
+    if (argc < 2 || argv[1][0] == '-') {
+        fprintf(stderr, "usage: %s <file.scene> [-path=file] [-frames=n] [-fps=n] [-size=WxH] [-fov=deg]\n"
+                        "       [-out=prefix] [-csv=file] [-warmup=n] [-threads=n] [-visbuffer] [-occlusion=off] [-lod=off]\n"
+                        "       [rasterizer flags]\n", argv[0]);
+        return 2;
+    }
+
+    // Rasterizer flags are matched anywhere in the command line, as in the player
+    size_t command_length = 1;
+    for (int i = 2; i < argc; i++) command_length += strlen(argv[i]) + 1;
+    char* command_line = (char*)calloc(command_length, 1);
+    if (!command_line) return 1;
+    for (int i = 2; i < argc; i++) {
+        strcat(command_line, argv[i]);
+        strcat(command_line, " ");
+    }
+
+    int width = 800, height = 600;
+    const char* option = find_option(argc, argv, "-size=");
+    if (option && (sscanf(option, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+        fprintf(stderr, "bad -size=%s\n", option);
+        return 2;
+    }
+    option = find_option(argc, argv, "-fps=");
+    float fps = option ? (float)atof(option) : 30.0f;
+    option = find_option(argc, argv, "-frames=");
+    int orbit_frames = option ? atoi(option) : 120;
+    option = find_option(argc, argv, "-fov=");
+    float fov_degrees = option ? (float)atof(option) : 90.0f;
+    option = find_option(argc, argv, "-warmup=");
+    int warmup = option ? atoi(option) : 2;
+    option = find_option(argc, argv, "-threads=");
+    int threads = option ? atoi(option) : 0;
+    const char* out_prefix = find_option(argc, argv, "-out=");
+    const char* csv_name = find_option(argc, argv, "-csv=");
+    const char* path_name = find_option(argc, argv, "-path=");
+    int use_visibility = find_option(argc, argv, "-visbuffer") != NULL;
+    int use_occlusion = find_option(argc, argv, "-occlusion=off") == NULL;
+    int use_lod = find_option(argc, argv, "-lod=off") == NULL;
+    if (fps <= 0.0f || orbit_frames <= 0) {
+        fprintf(stderr, "-fps and -frames must be positive\n");
+        return 2;
+    }
+
+    scene_t scene;
+    uint32_t sky_color = 0x303030;
+    scene_init(&scene);
+    if (!scene_load_from_file(&scene, argv[1], &sky_color)) {
+        fprintf(stderr, "cannot load %s\n", argv[1]);
+        return 1;
+    }
+
+    camera_path_t path = {0};
+    if (path_name ? !camera_path_load(&path, path_name) : !camera_path_orbit(&path, &scene, orbit_frames, fps)) {
+        fprintf(stderr, "cannot build the camera path%s%s\n", path_name ? " from " : "", path_name ? path_name : "");
+        return 1;
+    }
+    float start_time = path.keys[0].time;
+    int frame_count = (int)floorf((path.keys[path.count - 1].time - start_time) * fps + 1e-3f) + 1;
+
+    size_t pixel_count = (size_t)width * height;
+    render_target_t target;
+    target.color = (uint32_t*)malloc(pixel_count * sizeof(uint32_t));
+    target.depth = (float*)malloc(pixel_count * sizeof(float));
+    target.visibility = use_visibility ? (uint32_t*)malloc(pixel_count * sizeof(uint32_t)) : NULL;
+    target.width = width;
+    target.height = height;
+    frame_timing_t* timings = (frame_timing_t*)calloc(frame_count, sizeof(frame_timing_t));
+    if (!target.color || !target.depth || (use_visibility && !target.visibility) || !timings) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    raster_configure(command_line);
+    raster_init(threads);
+    render_set_occlusion_culling(use_occlusion);
+    render_set_level_of_detail(use_lod);
+
+    draw_order_t draw_order = {0};
+    render_camera_t camera;
+    camera.projection = mat4_perspective(fov_degrees * (3.14159f / 180.0f), (float)width / (float)height, NEAR_PLANE, FAR_PLANE);
+    camera.near_plane = NEAR_PLANE;
+    camera.far_plane = FAR_PLANE;
+
+    for (int frame = -warmup; frame < frame_count; frame++) {
+        vec3_t eye, look_target;
+        camera_path_sample(&path, start_time + (float)((frame < 0) ? 0 : frame) / fps, &eye, &look_target);
+        vec3_t forward = vec3_normalize(vec3_sub(look_target, eye));
+        vec3_t up_vector = (fabsf(forward.z) > 0.999f) ? (vec3_t){0, 1, 0} : (vec3_t){0, 0, 1};
+        camera.position = eye;
+        camera.view = mat4_look_at(eye, look_target, up_vector);
+
+        double frame_start = platform_time_seconds();
+        render_scene(&scene, &draw_order, &camera, &target, sky_color, -1);
+        double frame_end = platform_time_seconds();
+        if (frame < 0) continue;
+
+        raster_stats_t stats = raster_get_stats();
+        timings[frame].render_ms = (frame_end - frame_start) * 1000.0;
+        timings[frame].pixels_tested = stats.pixels_tested;
+        timings[frame].pixels_written = stats.pixels_written;
+        render_stats_t objects = render_get_stats();
+        timings[frame].objects_drawn = objects.objects_drawn;
+        timings[frame].objects_culled = objects.objects_culled;
+        timings[frame].objects_occluded = objects.objects_occluded;
+        timings[frame].objects_simplified = objects.objects_simplified;
+
+        if (out_prefix) {
+            char filename[1024];
+            snprintf(filename, sizeof(filename), "%s_%04d.ppm", out_prefix, frame);
+            if (!write_ppm(filename, target.color, width, height)) {
+                fprintf(stderr, "cannot write %s\n", filename);
+                return 1;
+            }
+        }
+    }
+
+    if (csv_name) {
+        FILE* csv = fopen(csv_name, "w");
+        if (!csv) {
+            fprintf(stderr, "cannot write %s\n", csv_name);
+            return 1;
+        }
+        fprintf(csv, "frame,time_s,render_ms,pixels_tested,pixels_written,objects_drawn,objects_culled,objects_occluded,objects_simplified\n");
+        for (int i = 0; i < frame_count; i++) {
+            fprintf(csv, "%d,%.4f,%.4f,%ld,%ld,%d,%d,%d,%d\n", i, start_time + (float)i / fps, timings[i].render_ms,
+                    timings[i].pixels_tested, timings[i].pixels_written, timings[i].objects_drawn,
+                    timings[i].objects_culled, timings[i].objects_occluded, timings[i].objects_simplified);
+        }
+        fclose(csv);
+    }
+
+    // Summary for quick comparisons; the CSV has the full series
+    double* sorted = (double*)malloc(frame_count * sizeof(double));
+    double total_ms = 0.0;
+    for (int i = 0; i < frame_count; i++) {
+        total_ms += timings[i].render_ms;
+        if (sorted) sorted[i] = timings[i].render_ms;
+    }
+    printf("%s: %d frames at %dx%d, mean %.3f ms", argv[1], frame_count, width, height, total_ms / frame_count);
+    if (sorted) {
+        qsort(sorted, frame_count, sizeof(double), compare_doubles);
+        printf(", min %.3f, median %.3f, p95 %.3f, max %.3f ms", sorted[0], sorted[frame_count / 2],
+               sorted[(int)((frame_count - 1) * 0.95)], sorted[frame_count - 1]);
+        free(sorted);
+    }
+    printf("\n");
+
+    render_shutdown();
+    raster_shutdown();
+    draw_order_free(&draw_order);
+    scene_destroy(&scene);
+    free(path.keys);
+    free(timings);
+    free(target.color);
+    free(target.depth);
+    free(target.visibility);
+    free(command_line);
+    return 0;
+}
@@ -0,0 +1,299 @@
+// scene.c
+// Runtime scene loading and mesh helpers shared by the player and the headless tools.
+
+#include "scene.h"
+#include "lod.h"
+#include "bake.h"
+#include "specular.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- Scene Management ---
+void mesh_calculate_normals(mesh_t* mesh) {
+    mesh_invalidate_vertex_streams(mesh); // Built again from the new normals on next use
+    if (!mesh || mesh->vertex_count == 0 || mesh->face_count == 0) {
+        if (mesh && mesh->normals) {
+            free(mesh->normals);
+            mesh->normals = NULL;
+        }
+        return;
+    }
+
+    if (mesh->normals) {
+        free(mesh->normals);
+    }
+    mesh->normals = (vec3_t*)calloc(mesh->vertex_count, sizeof(vec3_t));
+    if (!mesh->normals) return;
+
+    for (int i = 0; i < mesh->face_count; i++) {
+        int v0_idx = mesh->faces[i * 3 + 0];
+        int v1_idx = mesh->faces[i * 3 + 1];
+        int v2_idx = mesh->faces[i * 3 + 2];
+
+        // Ensure indices are within bounds
+        if (v0_idx >= mesh->vertex_count || v1_idx >= mesh->vertex_count || v2_idx >= mesh->vertex_count) continue;
+
+        vec3_t v0 = mesh->vertices[v0_idx];
+        vec3_t v1 = mesh->vertices[v1_idx];
+        vec3_t v2 = mesh->vertices[v2_idx];
+
+        vec3_t edge1 = vec3_sub(v1, v0);
+        vec3_t edge2 = vec3_sub(v2, v0);
+        vec3_t face_normal = vec3_cross(edge1, edge2);
+
+        mesh->normals[v0_idx] = vec3_add(mesh->normals[v0_idx], face_normal);
+        mesh->normals[v1_idx] = vec3_add(mesh->normals[v1_idx], face_normal);
+        mesh->normals[v2_idx] = vec3_add(mesh->normals[v2_idx], face_normal);
+    }
+
+    for (int i = 0; i < mesh->vertex_count; i++) {
+        mesh->normals[i] = vec3_normalize(mesh->normals[i]);
+    }
+}
+
+void scene_init(scene_t* scene) {
+    scene->capacity = 10;
+    scene->object_count = 0;
+    scene->objects = (scene_object_t**)malloc(scene->capacity * sizeof(scene_object_t*));
+}
+
+void destroy_mesh_data(mesh_t* mesh) {
+    if (!mesh) return;
+    if (mesh->vertices) free(mesh->vertices);
+    if (mesh->faces) free(mesh->faces);
+    if (mesh->normals) free(mesh->normals);
+    if (mesh->edges) free(mesh->edges);
+    free(mesh->vertex_streams);
+    free(mesh);
+}
+
+void scene_destroy(scene_t* scene) {
+    if (!scene || !scene->objects) return;
+    for (int i = 0; i < scene->object_count; i++) {
+        if (scene->objects[i]) {
+            destroy_mesh_data(scene->objects[i]->mesh);
+            scene_object_free_lods(scene->objects[i]);
+            scene_object_free_baked_lighting(scene->objects[i]);
+            if (scene->objects[i]->light_properties) { // NEW
+                free(scene->objects[i]->light_properties);
+            }
+            free(scene->objects[i]->children);
+            free(scene->objects[i]);
+        }
+    }
+    free(scene->objects);
+    scene->objects = NULL;
+    scene->object_count = 0;
+    scene->capacity = 0;
+}
+
+// --- Scene I/O ---
+// Vertex count, vertices, face count, faces; normals are computed rather than stored
+static mesh_t* read_mesh(FILE* file) {
+    mesh_t* mesh = (mesh_t*)malloc(sizeof(mesh_t));
+    if (!mesh) return NULL;
+    mesh->normals = NULL;
+    mesh->edges = NULL;
+    mesh->bounds_valid = 0;
+    mesh->vertex_streams = NULL;
+
+    fread(&mesh->vertex_count, sizeof(int), 1, file);
+    if (mesh->vertex_count > 0) {
+        mesh->vertices = (vec3_t*)malloc(mesh->vertex_count * sizeof(vec3_t));
+        fread(mesh->vertices, sizeof(vec3_t), mesh->vertex_count, file);
+    } else {
+        mesh->vertices = NULL;
+    }
+
+    fread(&mesh->face_count, sizeof(int), 1, file);
+    if (mesh->face_count > 0) {
+        mesh->faces = (int*)malloc(mesh->face_count * 3 * sizeof(int));
+        fread(mesh->faces, sizeof(int), mesh->face_count * 3, file);
+    } else {
+        mesh->faces = NULL;
+    }
+
+    mesh_calculate_normals(mesh);
+    return mesh;
+}
+
+// Vertex count, then that many colors; NULL if the count is 0 or does not match the mesh
+// the lighting was baked for (the colors are skipped either way)
+static vec3_t* read_baked_lighting(FILE* file, const mesh_t* mesh) {
+    int vertex_count = 0;
+    fread(&vertex_count, sizeof(int), 1, file);
+    if (vertex_count <= 0) return NULL;
+    vec3_t* lighting = (mesh && mesh->vertex_count == vertex_count) ? (vec3_t*)malloc(vertex_count * sizeof(vec3_t)) : NULL;
+    if (!lighting) {
+        fseek(file, vertex_count * (long)sizeof(vec3_t), SEEK_CUR);
+        return NULL;
+    }
+    fread(lighting, sizeof(vec3_t), vertex_count, file);
+    return lighting;
+}
+
+int scene_load_from_file(scene_t* scene, const char* filename, uint32_t* sky_color) {
+    if (!scene || !filename) return 0;
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    char header[4];
+    fread(header, sizeof(char), 4, file);
+
+    int is_scn6_format = (strncmp(header, "SCN6", 4) == 0);
+    int is_scn5_format = (strncmp(header, "SCN5", 4) == 0) || is_scn6_format; // SCN6 adds baked lighting after each mesh's LODs
+    int is_scn4_format = (strncmp(header, "SCN4", 4) == 0) || is_scn5_format; // SCN5 adds LOD meshes after each mesh
+    int is_scn3_format = (strncmp(header, "SCN3", 4) == 0);
+    int is_scn2_format = (strncmp(header, "SCN2", 4) == 0);
+    int is_scn1_format = (strncmp(header, "SCN1", 4) == 0);
+    
+    vec3_t sky_color_vec;
+    int object_count = 0;
+
+    if (is_scn4_format || is_scn3_format || is_scn2_format) {
+        fread(&sky_color_vec, sizeof(vec3_t), 1, file);
+        fread(&object_count, sizeof(int), 1, file);
+    } else if (is_scn1_format) {
+        sky_color_vec = (vec3_t){0.1875f, 0.1875f, 0.1875f}; 
+        fread(&object_count, sizeof(int), 1, file);
+    } else {
+        sky_color_vec = (vec3_t){0.1875f, 0.1875f, 0.1875f};
+        fseek(file, 0, SEEK_SET);
+        fread(&object_count, sizeof(int), 1, file);
+    }
+    
+    uint8_t r = (uint8_t)(sky_color_vec.x * 255.0f);
+    uint8_t g = (uint8_t)(sky_color_vec.y * 255.0f);
+    uint8_t b = (uint8_t)(sky_color_vec.z * 255.0f);
+    if (sky_color) *sky_color = (r << 16) | (g << 8) | b;
+
+    scene_destroy(scene);
+    scene_init(scene);
+
+    for (int i = 0; i < object_count; i++) {
+        if (scene->object_count >= scene->capacity) {
+            scene->capacity *= 2;
+            scene->objects = (scene_object_t**)realloc(scene->objects, scene->capacity * sizeof(scene_object_t*));
+        }
+        
+        scene_object_t* new_obj = (scene_object_t*)malloc(sizeof(scene_object_t));
+        if (!new_obj) continue;
+        
+        new_obj->child_count = 0;
+        new_obj->child_capacity = 4;
+        new_obj->lod_count = 0;
+        new_obj->lod_level = 0;
+        new_obj->lods_authored = is_scn5_format;
+        memset(new_obj->baked_lighting, 0, sizeof(new_obj->baked_lighting));
+        new_obj->children = (int*)malloc(new_obj->child_capacity * sizeof(int));
+
+        if (is_scn4_format) {
+            fread(new_obj->name, sizeof(char), 64, file); // Read the name, even though we don't use it in the player
+        }
+
+        fread(&new_obj->position, sizeof(vec3_t), 1, file);
+        fread(&new_obj->rotation, sizeof(vec3_t), 1, file);
+        fread(&new_obj->scale, sizeof(vec3_t), 1, file);
+
+        if (is_scn4_format || is_scn3_format || is_scn2_format) {
+            fread(&new_obj->material, sizeof(material_t), 1, file);
+        } else { 
+            vec3_t old_color;
+            fread(&old_color, sizeof(vec3_t), 1, file);
+            new_obj->material.diffuse_color = old_color;
+            new_obj->material.specular_intensity = 0.5f;
+            new_obj->material.shininess = 32.0f;
+        }
+
+        if (is_scn4_format || is_scn3_format) {
+            fread(&new_obj->parent_index, sizeof(int), 1, file);
+            fread(&new_obj->is_double_sided, sizeof(int), 1, file);
+            fread(&new_obj->is_static, sizeof(int), 1, file);
+            fread(&new_obj->is_player_spawn, sizeof(int), 1, file);
+            fread(&new_obj->has_collision, sizeof(int), 1, file);
+            fread(&new_obj->is_player_model, sizeof(int), 1, file);
+            fread(&new_obj->camera_offset, sizeof(vec3_t), 1, file);
+        } else if (is_scn2_format) {
+            fread(&new_obj->parent_index, sizeof(int), 1, file);
+            fread(&new_obj->is_double_sided, sizeof(int), 1, file);
+            fread(&new_obj->is_static, sizeof(int), 1, file);
+            fread(&new_obj->is_player_spawn, sizeof(int), 1, file);
+            fread(&new_obj->has_collision, sizeof(int), 1, file);
+            new_obj->is_player_model = 0;
+            new_obj->camera_offset = (vec3_t){0,0,0};
+        } else if (is_scn1_format) {
+            fread(&new_obj->parent_index, sizeof(int), 1, file);
+            fread(&new_obj->is_double_sided, sizeof(int), 1, file);
+            fread(&new_obj->is_static, sizeof(int), 1, file);
+            new_obj->is_player_spawn = 0;
+            new_obj->has_collision = 1; // <-- SET DEFAULT
+            new_obj->is_player_model = 0;
+            new_obj->camera_offset = (vec3_t){0,0,0};
+        } else {
+            new_obj->parent_index = -1;
+            new_obj->is_double_sided = 0;
+            new_obj->is_static = 0;
+            new_obj->is_player_spawn = 0;
+            new_obj->has_collision = 1; // <-- SET DEFAULT
+            new_obj->is_player_model = 0;
+            new_obj->camera_offset = (vec3_t){0,0,0};
+        }
+
+        int is_light = 0;
+        if (is_scn4_format || is_scn3_format || is_scn2_format || is_scn1_format) {
+            fread(&is_light, sizeof(int), 1, file);
+        }
+
+        if (is_light) {
+            new_obj->mesh = NULL;
+            new_obj->light_properties = (light_t*)malloc(sizeof(light_t));
+            fread(new_obj->light_properties, sizeof(light_t), 1, file);
+        } else {
+            new_obj->light_properties = NULL;
+            new_obj->mesh = read_mesh(file);
+            if (!new_obj->mesh) { free(new_obj->children); free(new_obj); continue; }
+
+            if (is_scn5_format) {
+                int lod_count = 0;
+                fread(&lod_count, sizeof(int), 1, file);
+                for (int l = 0; l < lod_count; l++) {
+                    mesh_t* lod = read_mesh(file);
+                    if (!scene_object_add_lod(new_obj, lod)) destroy_mesh_data(lod); // More levels than this build keeps
+                }
+            }
+            if (is_scn6_format) {
+                int baked_levels = 0;
+                fread(&baked_levels, sizeof(int), 1, file);
+                for (int l = 0; l < baked_levels; l++) {
+                    const mesh_t* mesh = (l == 0) ? new_obj->mesh : (l <= new_obj->lod_count) ? new_obj->lods[l - 1] : NULL;
+                    vec3_t* lighting = read_baked_lighting(file, mesh);
+                    if (lighting) new_obj->baked_lighting[l] = lighting;
+                }
+            }
+        }
+        scene->objects[scene->object_count++] = new_obj;
+    }
+
+    for (int i = 0; i < scene->object_count; i++) {
+        int parent_idx = scene->objects[i]->parent_index;
+        if (parent_idx != -1 && parent_idx < scene->object_count) {
+            scene_object_t* parent_obj = scene->objects[parent_idx];
+            if (parent_obj->child_count >= parent_obj->child_capacity) {
+                parent_obj->child_capacity *= 2;
+                parent_obj->children = (int*)realloc(parent_obj->children, parent_obj->child_capacity * sizeof(int));
+            }
+            parent_obj->children[parent_obj->child_count++] = i;
+        }
+    }
+
+    fclose(file);
+    if (!is_scn6_format) {
+        scene_bake_lighting(scene); // Saved before the editor baked; the parents are linked by now
+    }
+    specular_cache_prepare(scene);
+    return 1;
+}
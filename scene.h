@@ -0,0 +1,23 @@
+// scene.h
+// Runtime scene loading and mesh helpers: what the player and the headless tools need
+// from a .scene file. The editor keeps its own copies, which also save and edit.
+
+#ifndef SCENE_H
+#define SCENE_H
+#include <stdint.h>
+#include "math3d.h"
+
+// --- Scene Management ---
+void scene_init(scene_t* scene);
+void scene_destroy(scene_t* scene);
+void destroy_mesh_data(mesh_t* mesh);
+void mesh_calculate_normals(mesh_t* mesh);
+
+// --- Scene I/O ---
+// Reads every format the editor has written (SCN1..SCN6 and the headerless original). Files
+// older than SCN6 carry no baked lighting, so it is baked here (see bake.h). The specular
+// tables of the scene's materials are built here too (see specular.h).
+// sky_color receives the background as 0x00RRGGBB; returns 0 if the file cannot be opened.
+int scene_load_from_file(scene_t* scene, const char* filename, uint32_t* sky_color);
+
+#endif // SCENE_H
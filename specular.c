@@ -0,0 +1,91 @@
+// specular.c
+// Specular lookup table cache. Tables are allocated one by one so the pointers handed out
+// stay put while the index grows; lookups in it are a linear scan, as a scene only has a
+// handful of distinct shininess values. Once full, a miss rebuilds the least recently used
+// table in place, so an editor session that goes through many values keeps its tables.
+
+#include "specular.h"
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct {
+    float shininess;
+    float* values;      // SPECULAR_TABLE_SIZE samples
+    unsigned last_used; // g_specular_clock at the last lookup that returned it
+} specular_table_t;
+
+static specular_table_t* g_specular_tables = NULL;
+static int g_specular_table_count = 0;
+static int g_specular_table_capacity = 0;
+static unsigned g_specular_clock = 0;
+
+static void specular_fill_table(float* values, float shininess) {
+    for (int i = 0; i < SPECULAR_TABLE_SIZE; i++) {
+        float cos_angle = (float)i / (float)(SPECULAR_TABLE_SIZE - 1);
+        values[i] = powf(cos_angle, shininess);
+    }
+}
+
+const float* specular_table_get(float shininess) {
+    g_specular_clock++;
+    for (int i = 0; i < g_specular_table_count; i++) {
+        if (g_specular_tables[i].shininess == shininess) {
+            g_specular_tables[i].last_used = g_specular_clock;
+            return g_specular_tables[i].values;
+        }
+    }
+    if (g_specular_table_count >= SPECULAR_CACHE_MAX) {
+        specular_table_t* oldest = &g_specular_tables[0];
+        for (int i = 1; i < g_specular_table_count; i++) {
+            // Unsigned differences, so the order survives the clock wrapping around
+            if (g_specular_clock - g_specular_tables[i].last_used > g_specular_clock - oldest->last_used) oldest = &g_specular_tables[i];
+        }
+        specular_fill_table(oldest->values, shininess);
+        oldest->shininess = shininess;
+        oldest->last_used = g_specular_clock;
+        return oldest->values;
+    }
+
+    if (g_specular_table_count == g_specular_table_capacity) {
+        int new_capacity = (g_specular_table_capacity == 0) ? 8 : g_specular_table_capacity * 2;
+        specular_table_t* new_tables = (specular_table_t*)realloc(g_specular_tables, new_capacity * sizeof(specular_table_t));
+        if (!new_tables) return NULL;
+        g_specular_tables = new_tables;
+        g_specular_table_capacity = new_capacity;
+    }
+    float* values = (float*)malloc(SPECULAR_TABLE_SIZE * sizeof(float));
+    if (!values) return NULL;
+    specular_fill_table(values, shininess);
+
+    g_specular_tables[g_specular_table_count].shininess = shininess;
+    g_specular_tables[g_specular_table_count].values = values;
+    g_specular_tables[g_specular_table_count].last_used = g_specular_clock;
+    g_specular_table_count++;
+    return values;
+}
+
+void specular_cache_prepare(const scene_t* scene) {
+    for (int i = 0; i < scene->object_count; i++) {
+        const scene_object_t* object = scene->objects[i];
+        if (object->mesh && !object->light_properties && object->material.specular_intensity > 0.0f) {
+            specular_table_get(object->material.shininess);
+        }
+    }
+}
+
+void specular_cache_clear(void) {
+    for (int i = 0; i < g_specular_table_count; i++) free(g_specular_tables[i].values);
+    free(g_specular_tables);
+    g_specular_tables = NULL;
+    g_specular_table_count = 0;
+    g_specular_table_capacity = 0;
+}
+
+float specular_lookup(const float* table, float cos_angle) {
+    float position = cos_angle * (float)(SPECULAR_TABLE_SIZE - 1);
+    position = (position > 0.0f) ? position : 0.0f; // Also catches NaN
+    if (position >= (float)(SPECULAR_TABLE_SIZE - 1)) return table[SPECULAR_TABLE_SIZE - 1];
+    int index = (int)position;
+    float t = position - (float)index;
+    return table[index] + (table[index + 1] - table[index]) * t;
+}
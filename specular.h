@@ -0,0 +1,23 @@
+// specular.h
+// Shared cache of specular lookup tables: powf(cos_angle, shininess) sampled over 0..1, one
+// table per distinct shininess, so lighting does a table read instead of a powf() call.
+
+#ifndef SPECULAR_H
+#define SPECULAR_H
+#include "math3d.h"
+
+#define SPECULAR_TABLE_SIZE 1024 // Samples from cos_angle 0 to 1
+#define SPECULAR_CACHE_MAX 256   // Distinct shininess values kept; past that the least recently used table is rebuilt
+
+// The table for this shininess, built on first use. It stays valid until SPECULAR_CACHE_MAX
+// other shininess values have been asked for since, or specular_cache_clear(), so it can be
+// held while lighting one object. NULL when out of memory; callers then fall back to powf().
+const float* specular_table_get(float shininess);
+// Builds the tables of every material in the scene up front, so none is built mid-frame
+void specular_cache_prepare(const scene_t* scene);
+void specular_cache_clear(void);
+// powf(cos_angle, shininess) from the table, linearly interpolated between samples; cos_angle
+// is clamped to 0..1
+float specular_lookup(const float* table, float cos_angle);
+
+#endif // SPECULAR_H